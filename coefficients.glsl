@@ -0,0 +1,15 @@
+// Types the tiled kernels keep coefficients in while lifting. Builds with COEFFICIENTS_16 hold them
+// in 16-bit types, which halves the shared memory of a tile, and the float kernels run their
+// lifting steps in half precision. The integer kernels still do their arithmetic in 32 bits since
+// the weighted sums of the longer wavelets don't fit in 16.
+#ifdef COEFFICIENTS_16
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int16 : require
+#define coeff float16_t
+#define coeff4 f16vec4
+#define icoeff4 i16vec4
+#else
+#define coeff float
+#define coeff4 vec4
+#define icoeff4 ivec4
+#endif
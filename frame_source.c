@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "frame_source.h"
+#include "stb_image.h"
+
+static void append_path(struct FrameSource* source, uint32_t* capacity, char* path) {
+    if (source->num_paths == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        source->paths = (char**)realloc(source->paths, sizeof(char*) * *capacity);
+    }
+    source->paths[source->num_paths++] = path;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Adds every regular file in the directory, sorted by name so numbered sequences stay in order.
+static bool append_directory(struct FrameSource* source, uint32_t* capacity, const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        printf("Unable to open directory %s\n", dir_path);
+        return false;
+    }
+
+    const uint32_t first = source->num_paths;
+    const struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        const size_t length = strlen(dir_path) + strlen(entry->d_name) + 2;
+        char* path = (char*)malloc(length);
+        snprintf(path, length, "%s/%s", dir_path, entry->d_name);
+        struct stat info;
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+            free(path);
+            continue;
+        }
+        append_path(source, capacity, path);
+    }
+    closedir(dir);
+
+    qsort(source->paths + first, source->num_paths - first, sizeof(char*), compare_paths);
+    return true;
+}
+
+static uint8_t* alloc_frame_data(uint32_t alignment, uint32_t* capacity) {
+    *capacity = (*capacity + alignment - 1) & ~(alignment - 1);
+    return *capacity ? (uint8_t*)aligned_alloc(alignment, *capacity) : NULL;
+}
+
+static void decode_frame(struct FrameSource* source, struct SourceFrame* frame) {
+    int32_t width, height, num_channels;
+    uint8_t* data = stbi_load(frame->path, &width, &height, &num_channels, 4);
+    if (!data) {
+        printf("Unable to load image %s: %s\n", frame->path, stbi_failure_reason());
+        frame->width = 0;
+        frame->height = 0;
+        return;
+    }
+
+    const uint32_t size = width * height * 4;
+    if (size > frame->capacity) {
+        if (frame->data) {
+            pthread_mutex_lock(&source->mutex);
+            source->retired = (uint8_t**)realloc(source->retired, sizeof(uint8_t*) * (source->num_retired + 1));
+            source->retired[source->num_retired++] = frame->data;
+            pthread_mutex_unlock(&source->mutex);
+        }
+        frame->capacity = size;
+        frame->data = alloc_frame_data(source->alignment, &frame->capacity);
+    }
+    memcpy(frame->data, data, size);
+    frame->width = width;
+    frame->height = height;
+    stbi_image_free(data);
+}
+
+// Image i always goes to frame i % num_frames, so a thread can only pick up an image once the
+// consumer has released the one num_frames before it.
+static void* decode_thread(void* arg) {
+    struct FrameSource* source = (struct FrameSource*)arg;
+
+    pthread_mutex_lock(&source->mutex);
+    for (;;) {
+        while (!source->stop && source->next_decode < source->num_paths &&
+               source->next_decode >= source->num_released + source->num_frames) {
+            pthread_cond_wait(&source->frame_released, &source->mutex);
+        }
+        if (source->stop || source->next_decode == source->num_paths) {
+            break;
+        }
+
+        const uint32_t index = source->next_decode++;
+        struct SourceFrame* frame = &source->frames[index % source->num_frames];
+        frame->state = SOURCE_FRAME_DECODING;
+        frame->index = index;
+        frame->path = source->paths[index];
+        pthread_mutex_unlock(&source->mutex);
+
+        decode_frame(source, frame);
+
+        pthread_mutex_lock(&source->mutex);
+        frame->state = SOURCE_FRAME_READY;
+        pthread_cond_broadcast(&source->frame_decoded);
+    }
+    pthread_mutex_unlock(&source->mutex);
+    return NULL;
+}
+
+bool create_frame_source(struct FrameSource* out_source, const char** paths, uint32_t num_paths,
+                         uint32_t num_threads, uint32_t queue_depth, uint32_t alignment) {
+    memset(out_source, 0, sizeof(*out_source));
+    out_source->alignment = alignment > SOURCE_FRAME_MIN_ALIGNMENT ? alignment : SOURCE_FRAME_MIN_ALIGNMENT;
+
+    uint32_t capacity = 0;
+    for (uint32_t i = 0; i < num_paths; i++) {
+        struct stat info;
+        if (stat(paths[i], &info) == 0 && S_ISDIR(info.st_mode)) {
+            append_directory(out_source, &capacity, paths[i]);
+        } else {
+            append_path(out_source, &capacity, strdup(paths[i]));
+        }
+    }
+
+    if (num_threads == 0) {
+        num_threads = DEFAULT_DECODE_THREADS;
+    }
+    out_source->num_threads = num_threads < MAX_DECODE_THREADS ? num_threads : MAX_DECODE_THREADS;
+    out_source->num_frames = queue_depth ? queue_depth : out_source->num_threads * 2;
+
+    // Size the buffers for the first image, sequences rarely change resolution.
+    int32_t width = 0, height = 0, num_channels;
+    if (out_source->num_paths > 0 && !stbi_info(out_source->paths[0], &width, &height, &num_channels)) {
+        width = 0;
+        height = 0;
+    }
+    out_source->frames = (struct SourceFrame*)calloc(out_source->num_frames, sizeof(struct SourceFrame));
+    for (uint32_t i = 0; i < out_source->num_frames; i++) {
+        struct SourceFrame* frame = &out_source->frames[i];
+        frame->state = SOURCE_FRAME_FREE;
+        frame->capacity = width * height * 4;
+        frame->data = alloc_frame_data(out_source->alignment, &frame->capacity);
+    }
+
+    pthread_mutex_init(&out_source->mutex, NULL);
+    pthread_cond_init(&out_source->frame_released, NULL);
+    pthread_cond_init(&out_source->frame_decoded, NULL);
+
+    for (uint32_t i = 0; i < out_source->num_threads; i++) {
+        const int result = pthread_create(&out_source->threads[i], NULL, decode_thread, out_source);
+        if (result != 0) {
+            printf("Unable to create decode thread with result %d\n", result);
+            out_source->num_threads = i;
+            break;
+        }
+    }
+    if (out_source->num_threads == 0) {
+        destroy_frame_source(out_source);
+        return false;
+    }
+    return true;
+}
+
+const struct SourceFrame* frame_source_acquire(struct FrameSource* source) {
+    pthread_mutex_lock(&source->mutex);
+    if (source->next_acquire == source->num_paths) {
+        pthread_mutex_unlock(&source->mutex);
+        return NULL;
+    }
+
+    struct SourceFrame* frame = &source->frames[source->next_acquire % source->num_frames];
+    while (frame->state != SOURCE_FRAME_READY || frame->index != source->next_acquire) {
+        pthread_cond_wait(&source->frame_decoded, &source->mutex);
+    }
+    frame->state = SOURCE_FRAME_ACQUIRED;
+    source->next_acquire++;
+    pthread_mutex_unlock(&source->mutex);
+    return frame;
+}
+
+void frame_source_release(struct FrameSource* source, const struct SourceFrame* frame) {
+    pthread_mutex_lock(&source->mutex);
+    source->frames[frame->index % source->num_frames].state = SOURCE_FRAME_FREE;
+    source->num_released++;
+    pthread_cond_broadcast(&source->frame_released);
+    pthread_mutex_unlock(&source->mutex);
+}
+
+void destroy_frame_source(struct FrameSource* source) {
+    pthread_mutex_lock(&source->mutex);
+    source->stop = true;
+    pthread_cond_broadcast(&source->frame_released);
+    pthread_mutex_unlock(&source->mutex);
+    for (uint32_t i = 0; i < source->num_threads; i++) {
+        pthread_join(source->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&source->frame_decoded);
+    pthread_cond_destroy(&source->frame_released);
+    pthread_mutex_destroy(&source->mutex);
+    for (uint32_t i = 0; i < source->num_frames; i++) {
+        free(source->frames[i].data);
+    }
+    free(source->frames);
+    for (uint32_t i = 0; i < source->num_retired; i++) {
+        free(source->retired[i]);
+    }
+    free(source->retired);
+    for (uint32_t i = 0; i < source->num_paths; i++) {
+        free(source->paths[i]);
+    }
+    free(source->paths);
+}
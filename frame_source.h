@@ -0,0 +1,73 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_DECODE_THREADS 16
+#define DEFAULT_DECODE_THREADS 4
+// Frame buffers are aligned to at least a cache line.
+#define SOURCE_FRAME_MIN_ALIGNMENT 64
+
+enum SourceFrameState {
+    SOURCE_FRAME_FREE,
+    SOURCE_FRAME_DECODING,
+    SOURCE_FRAME_READY,
+    SOURCE_FRAME_ACQUIRED,
+};
+
+// Host buffer holding one decoded RGBA frame. Buffers are sized for the first frame of the
+// sequence up front and only grow if a later frame is larger. capacity is the size of the
+// allocation, a multiple of the source's alignment.
+struct SourceFrame {
+    enum SourceFrameState state;
+    // Position of the frame in the sequence.
+    uint32_t index;
+    const char* path;
+    // Zero if the frame couldn't be decoded.
+    uint32_t width;
+    uint32_t height;
+    uint8_t* data;
+    uint32_t capacity;
+};
+
+// Decodes a sequence of images on a pool of threads into a bounded queue of frames, which are
+// handed out in sequence order. Decoding runs ahead of the consumer as long as there are free frames.
+struct FrameSource {
+    char** paths;
+    uint32_t num_paths;
+    struct SourceFrame* frames;
+    uint32_t num_frames;
+    uint32_t alignment;
+    // Buffers outgrown by their frames. They stay allocated until the source is destroyed, since the
+    // GPU may still have them imported.
+    uint8_t** retired;
+    uint32_t num_retired;
+    pthread_t threads[MAX_DECODE_THREADS];
+    uint32_t num_threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t frame_released;
+    pthread_cond_t frame_decoded;
+    // Next image a thread picks up, and the next one handed out to the consumer.
+    uint32_t next_decode;
+    uint32_t next_acquire;
+    // Images below this index have been released by the consumer, their frames can be reused.
+    uint32_t num_released;
+    bool stop;
+};
+
+// Paths that name a directory are expanded to the files in it, sorted by name. num_threads and
+// queue_depth default to DEFAULT_DECODE_THREADS and twice the number of threads when zero.
+// alignment is a power of two that frame buffers are aligned and sized to, such as the context's
+// host_import_alignment so the GPU can read them in place. Zero means SOURCE_FRAME_MIN_ALIGNMENT.
+bool create_frame_source(struct FrameSource* out_source, const char** paths, uint32_t num_paths,
+                         uint32_t num_threads, uint32_t queue_depth, uint32_t alignment);
+
+// Blocks until the next frame of the sequence has been decoded. Returns NULL once the sequence is
+// exhausted. Frames must be released in the order they were acquired. The address of a frame's
+// buffer stays valid until the source is destroyed, even after the frame moves to a larger one.
+const struct SourceFrame* frame_source_acquire(struct FrameSource* source);
+
+void frame_source_release(struct FrameSource* source, const struct SourceFrame* frame);
+
+void destroy_frame_source(struct FrameSource* source);
@@ -0,0 +1,1254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "haar2d.h"
+#include "haar2d_hor_comp_spv.h"
+#include "haar2d_tiled_comp_spv.h"
+#include "haar2d_inv_comp_spv.h"
+#include "haar2d_inv_tiled_comp_spv.h"
+#include "haar2d_fused_comp_spv.h"
+#include "haar2d_inv_fused_comp_spv.h"
+#include "haar2d_int_comp_spv.h"
+#include "haar2d_int_inv_comp_spv.h"
+#include "haar2d_fused_comp_16_spv.h"
+#include "haar2d_inv_fused_comp_16_spv.h"
+#include "haar2d_fused_comp_shuffle_spv.h"
+#include "haar2d_inv_fused_comp_shuffle_spv.h"
+#include "haar2d_fused_comp_16_shuffle_spv.h"
+#include "haar2d_inv_fused_comp_16_shuffle_spv.h"
+#include "haar2d_fused_comp_buffer_spv.h"
+#include "haar2d_inv_fused_comp_buffer_spv.h"
+#include "haar2d_int_comp_16_spv.h"
+#include "haar2d_int_inv_comp_16_spv.h"
+#include "deinterleave_comp_spv.h"
+#include "interleave_comp_spv.h"
+#include "yuv_to_rgba_comp_spv.h"
+
+#define DEFAULT_BLOCK_DIM 32
+// Largest block the tiled kernels can keep in shared memory.
+#define MAX_TILE_DIM 32
+
+static const char* forward_stage_names[HAAR2D_MAX_LEVELS] = {
+    "haar level 0", "haar level 1", "haar level 2", "haar level 3", "haar level 4", "haar level 5",
+};
+
+static const char* inverse_stage_names[HAAR2D_MAX_LEVELS] = {
+    "inverse level 0", "inverse level 1", "inverse level 2", "inverse level 3", "inverse level 4", "inverse level 5",
+};
+
+// Builds of the fused kernels, by direction, 16-bit tiles and subgroup shuffles.
+static const struct {
+    const uint32_t* code;
+    uint32_t size;
+} fused_shaders[2][2][2] = {
+    {
+        {{HAAR2D_FUSED_COMP_SPV, sizeof(HAAR2D_FUSED_COMP_SPV)},
+         {HAAR2D_FUSED_COMP_SHUFFLE_SPV, sizeof(HAAR2D_FUSED_COMP_SHUFFLE_SPV)}},
+        {{HAAR2D_FUSED_COMP_16_SPV, sizeof(HAAR2D_FUSED_COMP_16_SPV)},
+         {HAAR2D_FUSED_COMP_16_SHUFFLE_SPV, sizeof(HAAR2D_FUSED_COMP_16_SHUFFLE_SPV)}},
+    },
+    {
+        {{HAAR2D_INV_FUSED_COMP_SPV, sizeof(HAAR2D_INV_FUSED_COMP_SPV)},
+         {HAAR2D_INV_FUSED_COMP_SHUFFLE_SPV, sizeof(HAAR2D_INV_FUSED_COMP_SHUFFLE_SPV)}},
+        {{HAAR2D_INV_FUSED_COMP_16_SPV, sizeof(HAAR2D_INV_FUSED_COMP_16_SPV)},
+         {HAAR2D_INV_FUSED_COMP_16_SHUFFLE_SPV, sizeof(HAAR2D_INV_FUSED_COMP_16_SHUFFLE_SPV)}},
+    },
+};
+
+static uint32_t input_planes(const struct Haar2DConfig* config) {
+    return config->input == HAAR2D_INPUT_RGBA || config->input == HAAR2D_INPUT_GRAY ? 1U : 3U;
+}
+
+// Chroma planes are halved horizontally for 4:2:0 and 4:2:2 and vertically for 4:2:0, rounding up.
+static void plane_extent(const struct Haar2DConfig* config, uint32_t plane, uint32_t* out_width, uint32_t* out_height) {
+    *out_width = config->width;
+    *out_height = config->height;
+    if (plane > 0 && (config->input == HAAR2D_INPUT_YUV420 || config->input == HAAR2D_INPUT_YUV422)) {
+        *out_width = (config->width + 1) / 2;
+    }
+    if (plane > 0 && config->input == HAAR2D_INPUT_YUV420) {
+        *out_height = (config->height + 1) / 2;
+    }
+}
+
+// Coefficients fill whole blocks, so planes that don't divide into blocks have their coefficients
+// padded up to the next block on the right and bottom edges.
+static void coefficient_extent(const struct Haar2DConfig* config, uint32_t plane, uint32_t* out_width,
+                               uint32_t* out_height) {
+    plane_extent(config, plane, out_width, out_height);
+    *out_width = (*out_width + config->block_dim - 1) / config->block_dim * config->block_dim;
+    *out_height = (*out_height + config->block_dim - 1) / config->block_dim * config->block_dim;
+}
+
+static bool whole_blocks(const struct Haar2DConfig* config) {
+    for (uint32_t i = 0; i < (config->planar ? input_planes(config) : 1U); i++) {
+        uint32_t width, height, padded_width, padded_height;
+        plane_extent(config, i, &width, &height);
+        coefficient_extent(config, i, &padded_width, &padded_height);
+        if (width != padded_width || height != padded_height) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether every level runs in one dispatch of the fused shaders.
+static bool fused_kernel(const struct Haar2DConfig* config) {
+    return config->kernel == HAAR2D_KERNEL_FUSED || config->kernel == HAAR2D_KERNEL_SUBGROUP;
+}
+
+// Whether samples and coefficients are kept apart, in images of different formats or sizes or in
+// buffers, which the transform reads from one and writes to the other in a single dispatch. Frames
+// that don't divide into blocks have larger coefficient images than sample images.
+static bool separate_coefficients(const struct Haar2DConfig* config) {
+    return config->lossless || config->half_coefficients || config->linear_buffers || !whole_blocks(config);
+}
+
+// Whether the lifting pipeline launches a workgroup per block, with a row of invocations for each
+// row of the block.
+static bool tiled_lifting(const struct Haar2DConfig* config) {
+    return config->kernel != HAAR2D_KERNEL_SERIAL || separate_coefficients(config);
+}
+
+static bool validate_config(struct Haar2DConfig* config) {
+    if (config->block_dim == 0) {
+        config->block_dim = DEFAULT_BLOCK_DIM;
+    }
+    if (config->levels == 0) {
+        config->levels = 1;
+    }
+    if (config->frames_in_flight == 0) {
+        config->frames_in_flight = 1;
+    }
+    if (config->bit_depth == 0) {
+        config->bit_depth = 8;
+    }
+
+    if ((config->block_dim & (config->block_dim - 1)) != 0) {
+        printf("Block size %u is not a power of two\n", config->block_dim);
+        return false;
+    }
+    if (config->levels > HAAR2D_MAX_LEVELS || (1U << config->levels) > config->block_dim) {
+        printf("Unable to run %u levels on %ux%u blocks\n", config->levels, config->block_dim, config->block_dim);
+        return false;
+    }
+    if (config->input > HAAR2D_INPUT_GRAY) {
+        printf("Unknown input layout %d\n", config->input);
+        return false;
+    }
+    // RGBA pixels are interleaved, there are no planes to transform separately.
+    if (config->input == HAAR2D_INPUT_RGBA) {
+        config->planar = false;
+    }
+    if (config->bit_depth != 8 && config->bit_depth != 16) {
+        printf("Unsupported bit depth %u, samples must have 8 or 16 bits\n", config->bit_depth);
+        return false;
+    }
+    if (config->bit_depth == 16 && !config->planar) {
+        printf("16-bit samples can only be transformed by planar engines\n");
+        return false;
+    }
+    // The inverse transform reads RGBA coefficients, there is no YUV frame to convert.
+    if (config->direction == HAAR2D_INVERSE && config->input != HAAR2D_INPUT_RGBA && !config->planar) {
+        printf("Inverse transforms of YUV input need a planar engine\n");
+        return false;
+    }
+    // The integer images can't be filled by the conversion pass, which writes normalized RGBA.
+    if (config->lossless && config->input != HAAR2D_INPUT_RGBA && !config->planar) {
+        printf("Lossless transforms need RGBA or planar input\n");
+        return false;
+    }
+    if (config->lossless && config->half_coefficients) {
+        printf("Lossless transforms have integer coefficients, they can't be stored as 16-bit floats\n");
+        return false;
+    }
+    if (separate_coefficients(config) && config->block_dim > MAX_TILE_DIM) {
+        if (!config->lossless && !config->half_coefficients && !config->linear_buffers) {
+            printf("Frames of %ux%u need blocks of at most %ux%u, they don't divide into %ux%u blocks\n",
+                   config->width, config->height, MAX_TILE_DIM, MAX_TILE_DIM, config->block_dim, config->block_dim);
+            return false;
+        }
+        printf("%s transforms do not support %ux%u blocks\n",
+               config->lossless ? "Lossless" : (config->half_coefficients ? "Half precision" : "Linear buffer"),
+               config->block_dim, config->block_dim);
+        return false;
+    }
+    // Shaders access the buffers in 16 byte words, which hold 4 pixels.
+    if (config->linear_buffers && (config->input != HAAR2D_INPUT_RGBA || config->lossless)) {
+        printf("Linear buffers only support float transforms of RGBA frames\n");
+        return false;
+    }
+    if (config->linear_buffers && (config->width % 4 != 0 || config->block_dim < 4)) {
+        printf("Linear buffers need frame widths and block sizes that are multiples of 4\n");
+        return false;
+    }
+    if (config->wavelet > HAAR2D_WAVELET_CDF_9_7) {
+        printf("Unknown wavelet %d\n", config->wavelet);
+        return false;
+    }
+    if (config->lossless && config->wavelet == HAAR2D_WAVELET_CDF_9_7) {
+        printf("CDF 9/7 is not reversible in integer arithmetic, use LeGall 5/3 for lossless transforms\n");
+        return false;
+    }
+    if (config->frames_in_flight > HAAR2D_MAX_FRAMES) {
+        printf("Unable to keep more than %d frames in flight\n", HAAR2D_MAX_FRAMES);
+        return false;
+    }
+    if (config->kernel != HAAR2D_KERNEL_SERIAL && config->block_dim > MAX_TILE_DIM) {
+        printf("Tiled kernels do not support %ux%u blocks, using the serial kernel\n",
+               config->block_dim, config->block_dim);
+        config->kernel = HAAR2D_KERNEL_SERIAL;
+    }
+    if (config->wavelet != HAAR2D_WAVELET_HAAR && !tiled_lifting(config)) {
+        printf("The serial kernel only implements the Haar wavelet\n");
+        return false;
+    }
+    return true;
+}
+
+// Specialization of the lifting pipeline for a level.
+static struct SpecConstants haar_spec(const struct Haar2DConfig* config, uint32_t level) {
+    struct SpecConstants spec = {.local_size_x = 8, .local_size_y = 8, .block_dim = config->block_dim, .level = level,
+                                 .wavelet = config->wavelet};
+    if (tiled_lifting(config)) {
+        spec.local_size_x = config->block_dim;
+        spec.local_size_y = config->block_dim < 8 ? config->block_dim : 8;
+    }
+    // Buffers hold 8-bit or 16-bit float coefficients, as numbered in linear_buffer.glsl.
+    if (config->linear_buffers) {
+        spec.format = config->half_coefficients ? 1 : 0;
+        spec.width = (int32_t)config->width;
+        spec.height = (int32_t)config->height;
+    }
+    return spec;
+}
+
+// The (de)interleave passes always place the subbands of every level at once.
+static struct SpecConstants interleave_spec(const struct Haar2DConfig* config) {
+    struct SpecConstants spec = {.local_size_x = 8, .local_size_y = 8, .block_dim = config->block_dim,
+                                 .level = config->levels - 1};
+    return spec;
+}
+
+// The conversion reads the planes of a frame, the shader numbers the layouts from 4:2:0 onwards.
+static struct SpecConstants convert_spec(const struct Haar2DConfig* config) {
+    struct SpecConstants spec = {.local_size_x = 8, .local_size_y = 8, .format = config->input - HAAR2D_INPUT_YUV420};
+    return spec;
+}
+
+// Planar engines keep every plane in an image of its own, anything else ends up in one RGBA image.
+// Lossless engines keep samples in unsigned integer images, which frames can be copied to as is.
+static VkFormat sample_format(const struct Haar2DConfig* config) {
+    if (config->lossless) {
+        if (!config->planar) {
+            return VK_FORMAT_R8G8B8A8_UINT;
+        }
+        return config->bit_depth == 16 ? VK_FORMAT_R16_UINT : VK_FORMAT_R8_UINT;
+    }
+    if (!config->planar) {
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+    return config->bit_depth == 16 ? VK_FORMAT_R16_UNORM : VK_FORMAT_R8_UNORM;
+}
+
+// Integer coefficients need a sign and one more bit per axis, since the low-pass band stays in
+// the sample range on every level, so they take twice the bits of the samples.
+static VkFormat coefficient_format(const struct Haar2DConfig* config) {
+    if (config->half_coefficients) {
+        return config->planar ? VK_FORMAT_R16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+    }
+    if (!config->lossless) {
+        return sample_format(config);
+    }
+    if (!config->planar) {
+        return VK_FORMAT_R16G16B16A16_SINT;
+    }
+    return config->bit_depth == 16 ? VK_FORMAT_R32_SINT : VK_FORMAT_R16_SINT;
+}
+
+// Bytes per sample of frames in the sample or coefficient layout.
+static uint32_t sample_size(const struct Haar2DConfig* config, bool coefficients) {
+    if (coefficients && config->lossless) {
+        return config->bit_depth > 8 ? 4 : 2;
+    }
+    if (coefficients && config->half_coefficients) {
+        return 2;
+    }
+    return config->bit_depth > 8 ? 2 : 1;
+}
+
+// Number of samples in a frame of samples or coefficients, over all planes and channels. Converted
+// YUV frames are transformed as RGBA.
+static uint32_t frame_samples(const struct Haar2DConfig* config, bool coefficients) {
+    const bool rgba = config->input == HAAR2D_INPUT_RGBA || (coefficients && !config->planar);
+    uint32_t num_samples = 0;
+    for (uint32_t i = 0; i < (rgba ? 1U : input_planes(config)); i++) {
+        uint32_t width, height;
+        if (coefficients) {
+            coefficient_extent(config, i, &width, &height);
+        } else {
+            plane_extent(config, i, &width, &height);
+        }
+        num_samples += width * height * (rgba ? 4 : 1);
+    }
+    return num_samples;
+}
+
+uint32_t input_frame_size(const struct Haar2DConfig* config) {
+    const bool inverse = config->direction == HAAR2D_INVERSE;
+    return frame_samples(config, inverse) * sample_size(config, inverse);
+}
+
+uint32_t output_frame_size(const struct Haar2DConfig* config) {
+    const bool forward = config->direction == HAAR2D_FORWARD;
+    return frame_samples(config, forward) * sample_size(config, forward);
+}
+
+// The dynamic offset of the binding selects the slice of the frame.
+static void write_convert_descriptor(const struct Haar2DEngine* engine, const struct Haar2DFrame* frame) {
+    const VkDescriptorBufferInfo buffer_info = {
+        .buffer = engine->context->staging.buffer,
+        .offset = 0,
+        .range = (input_frame_size(&engine->config) + 3) & ~3U,
+    };
+    const VkDescriptorImageInfo image_info = {
+        .sampler = NULL,
+        .imageView = frame->planes[0].texture.image_view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    const VkWriteDescriptorSet write_sets[2] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = NULL,
+            .dstSet = frame->convert_set,
+            .dstBinding = 0U,
+            .dstArrayElement = 0U,
+            .descriptorCount = 1U,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .pBufferInfo = &buffer_info,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = NULL,
+            .dstSet = frame->convert_set,
+            .dstBinding = 1U,
+            .dstArrayElement = 0U,
+            .descriptorCount = 1U,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = &image_info,
+        },
+    };
+    vkUpdateDescriptorSets(engine->context->device, 2U, write_sets, 0U, NULL);
+}
+
+// Linear buffer engines read the frame and write the coefficients through two storage buffers,
+// both bound to the staging ring.
+static void create_buffer_layout(struct Haar2DEngine* engine) {
+    VkDescriptorSetLayoutBinding bindings[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        bindings[i] = (VkDescriptorSetLayoutBinding){
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .descriptorCount = 1U,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+    const VkDescriptorSetLayoutCreateInfo layout_ci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .bindingCount = 2U,
+        .pBindings = bindings,
+    };
+    vkCreateDescriptorSetLayout(engine->context->device, &layout_ci, NULL, &engine->buffer_layout);
+}
+
+// The dynamic offsets of the bindings select the frame and readback slices.
+static void write_buffer_descriptor(const struct Haar2DEngine* engine, const struct Haar2DFrame* frame) {
+    const VkDescriptorBufferInfo buffer_infos[2] = {
+        {engine->context->staging.buffer, 0, input_frame_size(&engine->config)},
+        {engine->context->staging.buffer, 0, output_frame_size(&engine->config)},
+    };
+    VkWriteDescriptorSet write_sets[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        write_sets[i] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = NULL,
+            .dstSet = frame->buffer_set,
+            .dstBinding = i,
+            .dstArrayElement = 0U,
+            .descriptorCount = 1U,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .pBufferInfo = &buffer_infos[i],
+        };
+    }
+    vkUpdateDescriptorSets(engine->context->device, 2U, write_sets, 0U, NULL);
+}
+
+bool create_engine(struct Haar2DEngine* out_engine, struct VkContext* context, const struct Haar2DConfig* config) {
+    out_engine->config = *config;
+    if (!validate_config(&out_engine->config)) {
+        return false;
+    }
+    config = &out_engine->config;
+
+    // Every frame in flight needs a slice for the upload and one for the readback.
+    if ((1ULL * input_frame_size(config) + output_frame_size(config)) * config->frames_in_flight > STAGING_RING_SIZE) {
+        printf("Frame size %ux%u is too large for the staging ring\n", config->width, config->height);
+        return false;
+    }
+
+    // Create a headless context if the caller doesn't want to share one.
+    out_engine->owns_context = context == NULL;
+    if (out_engine->owns_context) {
+        if (volkInitialize() != VK_SUCCESS) {
+            printf("Unable to find a vulkan loader\n");
+            return false;
+        }
+        context = (struct VkContext*)calloc(1, sizeof(struct VkContext));
+        if (!create_context(context, NULL, 0U)) {
+            free(context);
+            return false;
+        }
+    }
+
+    // Single channel and integer storage images are optional, unlike normalized RGBA ones.
+    const VkFormat formats[2] = {sample_format(config), coefficient_format(config)};
+    for (uint32_t i = 0; i < 2 && !config->linear_buffers; i++) {
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(context->physical_device, formats[i], &format_properties);
+        if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+            printf("Unable to use format %d for storage images on this device\n", formats[i]);
+            if (out_engine->owns_context) {
+                destroy_context(context);
+                free(context);
+            }
+            return false;
+        }
+    }
+
+    // The single pass kernels have builds lifting 16-bit coefficients in 16-bit shared memory.
+    const bool int16_tiles = config->lossless && config->bit_depth == 8 && context->shader_int16;
+    const bool float16_tiles = config->half_coefficients && context->shader_float16;
+
+    // The tiled kernels keep a whole block, padded by a column, in shared memory and run up to 8
+    // of its rows at once. Devices only guarantee 16 KiB of shared memory and 128 invocations.
+    const uint32_t workgroup_size = config->block_dim * (config->block_dim < 8 ? config->block_dim : 8);
+    const uint32_t texel_size = (int16_tiles || float16_tiles) && !config->linear_buffers ? 8U : 16U;
+    const uint32_t tile_size = config->block_dim * (config->block_dim + 1) * texel_size;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+    if (tiled_lifting(config) && (tile_size > properties.limits.maxComputeSharedMemorySize ||
+                                  workgroup_size > properties.limits.maxComputeWorkGroupInvocations)) {
+        if (separate_coefficients(config) || config->wavelet != HAAR2D_WAVELET_HAAR) {
+            printf("Unable to fit %ux%u blocks in a workgroup on this device\n", config->block_dim, config->block_dim);
+            if (out_engine->owns_context) {
+                destroy_context(context);
+                free(context);
+            }
+            return false;
+        }
+        printf("Unable to fit %ux%u blocks in a workgroup on this device, using the serial kernel\n",
+               config->block_dim, config->block_dim);
+        out_engine->config.kernel = HAAR2D_KERNEL_SERIAL;
+    }
+
+    // Lanes exchange texels with the lane holding the other texel of a pair, which only works when
+    // every subgroup is full and covers an aligned run of a single block row. Only subgroup size
+    // control guarantees full subgroups, for workgroups whose width, a block row, is a multiple of
+    // the subgroup size.
+    if (config->kernel == HAAR2D_KERNEL_SUBGROUP &&
+        (!context->subgroup_shuffle || !context->subgroup_size_control ||
+         config->block_dim % context->subgroup_size != 0 ||
+         workgroup_size > context->max_workgroup_subgroups * context->subgroup_size)) {
+        printf("Unable to use subgroup shuffles on %ux%u blocks on this device, using the fused kernel\n",
+               config->block_dim, config->block_dim);
+        out_engine->config.kernel = HAAR2D_KERNEL_FUSED;
+    }
+
+    out_engine->context = context;
+    out_engine->frame_index = 0;
+    out_engine->num_planes = config->planar ? input_planes(config) : 1U;
+
+    // Planes follow each other without padding, so the offsets of odd sized planes aren't aligned
+    // enough for a transfer queue. The planes are copied on the compute queue in that case.
+    const bool inverse = config->direction == HAAR2D_INVERSE;
+    const uint32_t input_sample_size = sample_size(config, inverse);
+    out_engine->transfer_upload = config->input == HAAR2D_INPUT_RGBA || config->planar;
+    uint32_t plane_offset = 0;
+    for (uint32_t i = 0; i < out_engine->num_planes; i++) {
+        uint32_t width, height;
+        if (inverse) {
+            coefficient_extent(config, i, &width, &height);
+        } else {
+            plane_extent(config, i, &width, &height);
+        }
+        out_engine->plane_offsets[i] = plane_offset;
+        if (plane_offset % 4 != 0) {
+            out_engine->transfer_upload = false;
+        }
+        plane_offset += width * height * input_sample_size;
+    }
+
+    // The fused kernel writes the subbands in place so it doesn't need a second image. Lossless and
+    // half precision transforms run in one pass as well, but their images have different formats,
+    // as do frames that don't divide into blocks, whose coefficient images are padded.
+    const bool fused = fused_kernel(config) && !separate_coefficients(config);
+    const bool single_pass = fused || separate_coefficients(config);
+    const VkFormat input_format = inverse ? formats[1] : formats[0];
+    const VkFormat output_format = inverse ? formats[0] : formats[1];
+    for (uint32_t i = 0; i < config->frames_in_flight; i++) {
+        struct Haar2DFrame* frame = &out_engine->frames[i];
+        for (uint32_t j = 0; j < out_engine->num_planes; j++) {
+            struct Haar2DPlane* plane = &frame->planes[j];
+            uint32_t width, height, padded_width, padded_height;
+            plane_extent(config, j, &width, &height);
+            coefficient_extent(config, j, &padded_width, &padded_height);
+            if (config->linear_buffers) {
+                plane->output = NULL;
+                continue;
+            }
+            create_texture(context, &plane->texture, inverse ? padded_width : width, inverse ? padded_height : height,
+                           input_format, input_format);
+            if (!fused) {
+                create_texture(context, &plane->texture_de, inverse ? width : padded_width,
+                               inverse ? height : padded_height, output_format, output_format);
+            }
+            plane->output = fused ? &plane->texture : &plane->texture_de;
+        }
+        frame->initialized = false;
+        frame->pending = false;
+    }
+    out_engine->output = out_engine->frames[0].planes[0].output;
+    memset(out_engine->imports, 0, sizeof(out_engine->imports));
+
+    // All images create identical layouts whatever their format, so the pipelines are compatible
+    // with all of them.
+    const struct VkTexture* texture = &out_engine->frames[0].planes[0].texture;
+
+    // The inverse transform runs the same passes backwards, starting from the subband layout.
+    if (config->linear_buffers) {
+        create_buffer_layout(out_engine);
+        create_pipeline(context, &out_engine->pipeline, out_engine->buffer_layout,
+                        inverse ? HAAR2D_INV_FUSED_COMP_BUFFER_SPV : HAAR2D_FUSED_COMP_BUFFER_SPV,
+                        inverse ? sizeof(HAAR2D_INV_FUSED_COMP_BUFFER_SPV) : sizeof(HAAR2D_FUSED_COMP_BUFFER_SPV));
+    } else if (int16_tiles) {
+        create_pipeline(context, &out_engine->pipeline, texture->desc_layout_2,
+                        inverse ? HAAR2D_INT_INV_COMP_16_SPV : HAAR2D_INT_COMP_16_SPV,
+                        inverse ? sizeof(HAAR2D_INT_INV_COMP_16_SPV) : sizeof(HAAR2D_INT_COMP_16_SPV));
+    } else if (config->lossless) {
+        create_pipeline(context, &out_engine->pipeline, texture->desc_layout_2,
+                        inverse ? HAAR2D_INT_INV_COMP_SPV : HAAR2D_INT_COMP_SPV,
+                        inverse ? sizeof(HAAR2D_INT_INV_COMP_SPV) : sizeof(HAAR2D_INT_COMP_SPV));
+    } else if (single_pass) {
+        const bool shuffle = config->kernel == HAAR2D_KERNEL_SUBGROUP;
+        create_pipeline(context, &out_engine->pipeline, texture->desc_layout_2,
+                        fused_shaders[inverse][float16_tiles][shuffle].code,
+                        fused_shaders[inverse][float16_tiles][shuffle].size);
+        out_engine->pipeline.required_subgroup_size = shuffle ? context->subgroup_size : 0U;
+    } else if (config->kernel == HAAR2D_KERNEL_TILED) {
+        create_pipeline(context, &out_engine->pipeline, texture->desc_layout,
+                        inverse ? HAAR2D_INV_TILED_COMP_SPV : HAAR2D_TILED_COMP_SPV,
+                        inverse ? sizeof(HAAR2D_INV_TILED_COMP_SPV) : sizeof(HAAR2D_TILED_COMP_SPV));
+    } else {
+        create_pipeline(context, &out_engine->pipeline, texture->desc_layout,
+                        inverse ? HAAR2D_INV_COMP_SPV : HAAR2D_HOR_COMP_SPV,
+                        inverse ? sizeof(HAAR2D_INV_COMP_SPV) : sizeof(HAAR2D_HOR_COMP_SPV));
+    }
+    if (!single_pass) {
+        create_pipeline(context, &out_engine->d_pipeline, texture->desc_layout_2,
+                        inverse ? INTERLEAVE_COMP_SPV : DEINTERLEAVE_COMP_SPV,
+                        inverse ? sizeof(INTERLEAVE_COMP_SPV) : sizeof(DEINTERLEAVE_COMP_SPV));
+    }
+
+    // YUV input is converted straight from the staging ring, at the offset of each frame's slice.
+    const bool convert = config->input != HAAR2D_INPUT_RGBA && !config->planar;
+    if (convert) {
+        const VkDescriptorSetLayoutBinding convert_bindings[2] = {
+            {
+                .binding = 0U,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                .descriptorCount = 1U,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = NULL,
+            },
+            {
+                .binding = 1U,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .descriptorCount = 1U,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = NULL,
+            }
+        };
+        const VkDescriptorSetLayoutCreateInfo convert_layout_ci = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = NULL,
+            .bindingCount = 2U,
+            .pBindings = convert_bindings,
+        };
+        vkCreateDescriptorSetLayout(context->device, &convert_layout_ci, NULL, &out_engine->convert_layout);
+        create_pipeline(context, &out_engine->convert_pipeline, out_engine->convert_layout,
+                        YUV_TO_RGBA_COMP_SPV, sizeof(YUV_TO_RGBA_COMP_SPV));
+        const struct SpecConstants spec = convert_spec(config);
+        get_pipeline(&out_engine->convert_pipeline, &spec);
+    }
+
+    // Specialize every variant up front so recording never has to compile a pipeline.
+    if (single_pass) {
+        const struct SpecConstants spec = haar_spec(config, config->levels - 1);
+        get_pipeline(&out_engine->pipeline, &spec);
+    } else {
+        for (uint32_t i = 0; i < config->levels; i++) {
+            const struct SpecConstants spec = haar_spec(config, i);
+            get_pipeline(&out_engine->pipeline, &spec);
+        }
+        const struct SpecConstants spec = interleave_spec(config);
+        get_pipeline(&out_engine->d_pipeline, &spec);
+    }
+
+    // Make a descriptor pool to allocate the storage image and buffer descriptors we need.
+    const uint32_t num_images = config->frames_in_flight * out_engine->num_planes;
+    const VkDescriptorPoolSize pool_sizes[2] = {
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4 * num_images},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2 * config->frames_in_flight},
+    };
+    const VkDescriptorPoolCreateInfo descriptor_pool_ci = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .maxSets = 2 * num_images + config->frames_in_flight,
+        .poolSizeCount = 2U,
+        .pPoolSizes = pool_sizes,
+    };
+    vkCreateDescriptorPool(context->device, &descriptor_pool_ci, NULL, &out_engine->desc_pool);
+
+    // Allocate one descriptor for each pipeline and plane of every frame.
+    for (uint32_t i = 0; i < config->frames_in_flight; i++) {
+        struct Haar2DFrame* frame = &out_engine->frames[i];
+        VkDescriptorSetAllocateInfo allocate_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = NULL,
+            .descriptorPool = out_engine->desc_pool,
+            .descriptorSetCount = 1U,
+            .pSetLayouts = &texture->desc_layout,
+        };
+        if (config->linear_buffers) {
+            allocate_info.pSetLayouts = &out_engine->buffer_layout;
+            vkAllocateDescriptorSets(context->device, &allocate_info, &frame->buffer_set);
+            write_buffer_descriptor(out_engine, frame);
+            continue;
+        }
+        for (uint32_t j = 0; j < out_engine->num_planes; j++) {
+            struct Haar2DPlane* plane = &frame->planes[j];
+            allocate_info.pSetLayouts = &texture->desc_layout;
+            vkAllocateDescriptorSets(context->device, &allocate_info, &plane->desc_set);
+
+            allocate_info.pSetLayouts = &texture->desc_layout_2;
+            vkAllocateDescriptorSets(context->device, &allocate_info, &plane->desc_set_2);
+
+            // Update allocated sets with our image. The lifting steps run on the uploaded image when
+            // going forward and on the interleaved coefficients when going backwards. The fused
+            // kernel reads and writes the same image, so it's bound as both.
+            const struct VkTexture* textures[2] = {&plane->texture, fused ? &plane->texture : &plane->texture_de};
+            write_as_storage_descriptor(plane->desc_set, inverse && !fused ? &textures[1] : textures, 1U);
+            write_as_storage_descriptor(plane->desc_set_2, textures, 2U);
+        }
+
+        if (convert) {
+            allocate_info.pSetLayouts = &out_engine->convert_layout;
+            vkAllocateDescriptorSets(context->device, &allocate_info, &frame->convert_set);
+            write_convert_descriptor(out_engine, frame);
+        }
+    }
+
+    // Make command pools to allocate command buffers, the transform runs on the compute queue while
+    // uploads and readbacks go through the transfer queue.
+    VkCommandPoolCreateInfo command_pool_ci = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = context->queues[QUEUE_COMPUTE].family,
+    };
+    vkCreateCommandPool(context->device, &command_pool_ci, NULL, &out_engine->command_pool);
+    command_pool_ci.queueFamilyIndex = context->queues[QUEUE_TRANSFER].family;
+    vkCreateCommandPool(context->device, &command_pool_ci, NULL, &out_engine->transfer_pool);
+
+    VkCommandBufferAllocateInfo buffer_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = out_engine->command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1U,
+    };
+    for (uint32_t i = 0; i < config->frames_in_flight; i++) {
+        struct Haar2DFrame* frame = &out_engine->frames[i];
+        buffer_alloc_info.commandPool = out_engine->command_pool;
+        vkAllocateCommandBuffers(context->device, &buffer_alloc_info, &frame->cmdbuf);
+        buffer_alloc_info.commandPool = out_engine->transfer_pool;
+        vkAllocateCommandBuffers(context->device, &buffer_alloc_info, &frame->upload_cmdbuf);
+        vkAllocateCommandBuffers(context->device, &buffer_alloc_info, &frame->readback_cmdbuf);
+    }
+
+    if (config->profile) {
+        create_profiler(context, &out_engine->profiler, config->frames_in_flight);
+    } else {
+        memset(&out_engine->profiler, 0, sizeof(out_engine->profiler));
+    }
+
+    return true;
+}
+
+// Runs a pass over every plane, sizing each dispatch from the plane so subsampled chroma only gets
+// the workgroups it needs. The planes are independent, so their dispatches can overlap. Passes
+// reading one image and writing the other use the second descriptor set of each plane.
+static void record_pass(struct Haar2DEngine* engine, struct Haar2DFrame* frame, VkCommandBuffer cmdbuf,
+                        struct VkCompPipeline* pipeline, const struct SpecConstants* spec, bool two_images,
+                        const char* name) {
+    // The tiled lifting kernels launch a workgroup per block and the serial kernel a workgroup per
+    // 8x8 blocks, since each invocation transforms a whole block. The per-pixel passes launch a
+    // workgroup per 8x8 pixels.
+    uint32_t dim = 8;
+    if (pipeline == &engine->pipeline) {
+        dim = tiled_lifting(&engine->config) ? engine->config.block_dim : 8 * engine->config.block_dim;
+    }
+
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, get_pipeline(pipeline, spec));
+    profiler_begin(cmdbuf, &engine->profiler, name);
+    for (uint32_t i = 0; i < engine->num_planes; i++) {
+        const struct Haar2DPlane* plane = &frame->planes[i];
+        vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout, 0U, 1U,
+                                two_images ? &plane->desc_set_2 : &plane->desc_set, 0U, NULL);
+        vkCmdDispatch(cmdbuf, (plane->texture.width + dim - 1) / dim, (plane->texture.height + dim - 1) / dim, 1);
+    }
+    profiler_end(cmdbuf, &engine->profiler);
+}
+
+// Makes the writes of a pass to the lifted images visible to the next pass.
+static void record_pass_barrier(struct Haar2DEngine* engine, struct Haar2DFrame* frame, VkCommandBuffer cmdbuf,
+                                bool texture_de) {
+    for (uint32_t i = 0; i < engine->num_planes; i++) {
+        struct Haar2DPlane* plane = &frame->planes[i];
+        transition_layout(cmdbuf, texture_de ? &plane->texture_de : &plane->texture, VK_IMAGE_LAYOUT_GENERAL,
+                          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+}
+
+static void record_forward(struct Haar2DEngine* engine, struct Haar2DFrame* frame, VkCommandBuffer cmdbuf) {
+    // Every level has a pipeline of its own.
+    for (uint32_t i = 0; i < engine->config.levels; i++) {
+        const struct SpecConstants spec = haar_spec(&engine->config, i);
+        record_pass(engine, frame, cmdbuf, &engine->pipeline, &spec, false, forward_stage_names[i]);
+
+        // Each level reads the low-pass band written by the previous one, and the last one is
+        // read by the deinterleave pass.
+        record_pass_barrier(engine, frame, cmdbuf, false);
+    }
+
+    const struct SpecConstants spec = interleave_spec(&engine->config);
+    record_pass(engine, frame, cmdbuf, &engine->d_pipeline, &spec, true, "deinterleave");
+}
+
+static void record_inverse(struct Haar2DEngine* engine, struct Haar2DFrame* frame, VkCommandBuffer cmdbuf) {
+    // Gather the subbands back to the positions the lifting steps expect.
+    const struct SpecConstants spec = interleave_spec(&engine->config);
+    record_pass(engine, frame, cmdbuf, &engine->d_pipeline, &spec, true, "interleave");
+    record_pass_barrier(engine, frame, cmdbuf, true);
+
+    // Undo the levels starting from the coarsest one, reconstructing the frame in texture_de.
+    for (uint32_t i = engine->config.levels; i-- > 0;) {
+        const struct SpecConstants level_spec = haar_spec(&engine->config, i);
+        record_pass(engine, frame, cmdbuf, &engine->pipeline, &level_spec, false, inverse_stage_names[i]);
+        record_pass_barrier(engine, frame, cmdbuf, true);
+    }
+}
+
+// Records every pass of the transform, starting from the uploaded frame in the textures.
+static void record_passes(struct Haar2DEngine* engine, struct Haar2DFrame* frame, VkCommandBuffer cmdbuf) {
+    if (engine->config.lossless) {
+        // Reads the samples or coefficients from texture and writes the other kind to texture_de.
+        const struct SpecConstants spec = haar_spec(&engine->config, engine->config.levels - 1);
+        record_pass(engine, frame, cmdbuf, &engine->pipeline, &spec, true,
+                    engine->config.direction == HAAR2D_INVERSE ? "inverse lossless" : "haar lossless");
+    } else if (fused_kernel(&engine->config) || separate_coefficients(&engine->config)) {
+        // All levels and the subband placement happen in a single dispatch, in place unless the
+        // coefficients have an image of their own.
+        const struct SpecConstants spec = haar_spec(&engine->config, engine->config.levels - 1);
+        record_pass(engine, frame, cmdbuf, &engine->pipeline, &spec, true, "haar fused");
+    } else if (engine->config.direction == HAAR2D_INVERSE) {
+        record_inverse(engine, frame, cmdbuf);
+    } else {
+        record_forward(engine, frame, cmdbuf);
+    }
+}
+
+// Fills the frame's textures from a staging slice holding an input frame. RGBA frames and planes
+// are copied, YUV frames for an RGBA engine are converted by a compute pass.
+static void record_upload(struct Haar2DEngine* engine, struct Haar2DFrame* frame, VkCommandBuffer cmdbuf,
+                          const struct VkStagingSlice* slice) {
+    if (engine->config.input == HAAR2D_INPUT_RGBA || engine->config.planar) {
+        profiler_begin(cmdbuf, &engine->profiler, "upload");
+        for (uint32_t i = 0; i < engine->num_planes; i++) {
+            struct VkStagingSlice plane_slice = *slice;
+            plane_slice.offset += engine->plane_offsets[i];
+            plane_slice.data += engine->plane_offsets[i];
+            upload_image_slice(cmdbuf, &plane_slice, &frame->planes[i].texture);
+        }
+        profiler_end(cmdbuf, &engine->profiler);
+        return;
+    }
+
+    const uint32_t offset = (uint32_t)slice->offset;
+    vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, engine->convert_pipeline.layout, 0U, 1U,
+                            &frame->convert_set, 1U, &offset);
+    const struct SpecConstants spec = convert_spec(&engine->config);
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, get_pipeline(&engine->convert_pipeline, &spec));
+    profiler_begin(cmdbuf, &engine->profiler, "convert");
+    vkCmdDispatch(cmdbuf, (engine->config.width + 7) / 8, (engine->config.height + 7) / 8, 1);
+    profiler_end(cmdbuf, &engine->profiler);
+}
+
+bool record_transform(struct Haar2DEngine* engine, VkCommandBuffer cmdbuf, const uint8_t* data, uint32_t size) {
+    if (engine->config.linear_buffers) {
+        printf("Engines with linear buffers have no image to record a transform into\n");
+        return false;
+    }
+    const uint32_t slot = engine->frame_index;
+    struct Haar2DFrame* frame = &engine->frames[slot];
+    const bool fused = frame->planes[0].output == &frame->planes[0].texture;
+
+    // Stage the frame before recording anything. Without room in the ring the frame is skipped,
+    // its slot included so the rotation stays in step with the caller's, and engine->output keeps
+    // the previous result.
+    const uint32_t frame_size = input_frame_size(&engine->config);
+    struct VkStagingSlice slice;
+    if (!staging_alloc(&engine->context->staging, frame_size, &slice)) {
+        engine->frame_index = (slot + 1) % engine->config.frames_in_flight;
+        return false;
+    }
+    memcpy(slice.data, data, size < frame_size ? size : frame_size);
+    engine->output = frame->planes[0].output;
+
+    profiler_reset(&engine->profiler, slot);
+
+    // YUV input for an RGBA engine is written to the texture by a compute pass instead of a copy.
+    const bool convert = engine->config.input != HAAR2D_INPUT_RGBA && !engine->config.planar;
+    const VkAccessFlagBits upload_access = convert ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+    const VkPipelineStageFlagBits upload_stage =
+        convert ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    // Transition from undefined to general the first time, otherwise wait for the previous transform
+    // to finish reading the image before overwriting it. The fused output is read by transfers.
+    for (uint32_t i = 0; i < engine->num_planes; i++) {
+        struct Haar2DPlane* plane = &frame->planes[i];
+        if (!frame->initialized) {
+            transition_layout(cmdbuf, &plane->texture, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE, VK_ACCESS_NONE,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            if (!fused) {
+                transition_layout(cmdbuf, &plane->texture_de, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE,
+                                  VK_ACCESS_NONE, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            }
+        } else {
+            transition_layout(cmdbuf, &plane->texture, VK_IMAGE_LAYOUT_GENERAL,
+                              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+                              upload_access, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                              upload_stage);
+        }
+    }
+    frame->initialized = true;
+
+    // Upload image to vulkan image.
+    record_upload(engine, frame, cmdbuf, &slice);
+
+    for (uint32_t i = 0; i < engine->num_planes; i++) {
+        transition_layout(cmdbuf, &frame->planes[i].texture, VK_IMAGE_LAYOUT_GENERAL, upload_access,
+                          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                          upload_stage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    record_passes(engine, frame, cmdbuf);
+
+    engine->frame_index = (slot + 1) % engine->config.frames_in_flight;
+    return true;
+}
+
+// Waits for a pending frame and gives its staging slices back to the ring.
+static void retire_frame(struct Haar2DEngine* engine, uint32_t slot) {
+    struct Haar2DFrame* frame = &engine->frames[slot];
+    timeline_wait(engine->context, frame->value);
+    profiler_collect(&engine->profiler, slot);
+    staging_release(&engine->context->staging, frame->value);
+    frame->pending = false;
+}
+
+static void begin_commands(VkCommandBuffer cmdbuf) {
+    const VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkBeginCommandBuffer(cmdbuf, &begin_info);
+}
+
+bool stage_frame(struct Haar2DEngine* engine, struct VkStagingSlice* out_slice) {
+    // The resources of the frame are reused, so wait for the frame submitted frames_in_flight ago.
+    // Its held readback slice may also be needed to make room in the ring.
+    const uint32_t slot = engine->frame_index;
+    if (engine->frames[slot].pending) {
+        retire_frame(engine, slot);
+    }
+    return staging_alloc(&engine->context->staging, input_frame_size(&engine->config), out_slice);
+}
+
+bool submit_frame(struct Haar2DEngine* engine, const uint8_t* data, uint32_t size) {
+    struct VkStagingSlice slice;
+    if (!stage_frame(engine, &slice)) {
+        submit_staged_frame(engine, NULL);
+        return false;
+    }
+
+    const uint32_t frame_size = input_frame_size(&engine->config);
+    memcpy(slice.data, data, size < frame_size ? size : frame_size);
+    return submit_staged_frame(engine, &slice);
+}
+
+// Returns the cached import of the allocation at data, importing it on first use. A new import
+// takes an unused entry, or else one whose frames have all completed. Returns NULL when no entry is
+// free or the device can't import the allocation.
+static struct Haar2DImport* find_import(struct Haar2DEngine* engine, uint8_t* data, uint32_t size) {
+    struct Haar2DImport* unused = NULL;
+    struct Haar2DImport* completed = NULL;
+    for (uint32_t i = 0; i < HAAR2D_MAX_IMPORTS; i++) {
+        struct Haar2DImport* import = &engine->imports[i];
+        if (import->data == data && import->size == size) {
+            return import;
+        }
+        if (import->data == NULL) {
+            unused = unused ? unused : import;
+        } else if (!completed && timeline_reached(engine->context, import->value)) {
+            completed = import;
+        }
+    }
+
+    struct Haar2DImport* import = unused ? unused : completed;
+    struct VkHostImport host_import;
+    struct VkStagingSlice slice;
+    if (!import || !import_host_memory(engine->context, data, size, &host_import, &slice)) {
+        return NULL;
+    }
+    if (import->data) {
+        release_host_import(engine->context->device, &import->import);
+    }
+    import->data = data;
+    import->size = size;
+    import->import = host_import;
+    import->value = 0;
+    return import;
+}
+
+bool submit_host_frame(struct Haar2DEngine* engine, uint8_t* data, uint32_t size) {
+    // Only copies to the images can take their source from any buffer.
+    const bool copied = (engine->config.input == HAAR2D_INPUT_RGBA || engine->config.planar) &&
+                        !engine->config.linear_buffers;
+    const uint32_t slot = engine->frame_index;
+    if (engine->frames[slot].pending) {
+        retire_frame(engine, slot);
+    }
+
+    struct Haar2DImport* import = copied && size >= input_frame_size(&engine->config)
+                                      ? find_import(engine, data, size)
+                                      : NULL;
+    if (!import) {
+        return submit_frame(engine, data, size);
+    }
+    const struct VkStagingSlice slice = {
+        .buffer = import->import.buffer,
+        .offset = 0,
+        .size = size,
+        .data = data,
+    };
+    const bool submitted = submit_staged_frame(engine, &slice);
+    import->value = engine->frames[slot].value;
+    return submitted;
+}
+
+// Transforms a frame straight from its staging slice into a readback slice in a single dispatch on
+// the compute queue, without any images to copy to or hand over between queues.
+static bool submit_linear_frame(struct Haar2DEngine* engine, uint32_t slot, const struct VkStagingSlice* slice) {
+    struct Haar2DFrame* frame = &engine->frames[slot];
+    struct Haar2DPlane* plane = &frame->planes[0];
+    struct VkContext* context = engine->context;
+    const uint32_t block_dim = engine->config.block_dim;
+
+    bool recorded = slice != NULL &&
+                    staging_alloc(&context->staging, output_frame_size(&engine->config), &plane->readback);
+    if (recorded) {
+        const VkCommandBuffer cmdbuf = frame->cmdbuf;
+        begin_commands(cmdbuf);
+        const uint32_t offsets[2] = {(uint32_t)slice->offset, (uint32_t)plane->readback.offset};
+        vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, engine->pipeline.layout, 0U, 1U,
+                                &frame->buffer_set, 2U, offsets);
+        const struct SpecConstants spec = haar_spec(&engine->config, engine->config.levels - 1);
+        vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, get_pipeline(&engine->pipeline, &spec));
+        profiler_begin(cmdbuf, &engine->profiler, "haar linear");
+        vkCmdDispatch(cmdbuf, (engine->config.width + block_dim - 1) / block_dim,
+                      (engine->config.height + block_dim - 1) / block_dim, 1);
+        profiler_end(cmdbuf, &engine->profiler);
+
+        const VkMemoryBarrier host_barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = NULL,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             1U, &host_barrier, 0U, NULL, 0U, NULL);
+        vkEndCommandBuffer(cmdbuf);
+    }
+    frame->value = submit_commands(context, QUEUE_COMPUTE, &frame->cmdbuf, recorded ? 1U : 0U, 0U,
+                                   VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+    // Without a hold the readback slice would be recycled before it is fetched, so drop the result.
+    if (!staging_end_frame(&context->staging, frame->value, true)) {
+        recorded = false;
+    }
+    // Some of the timestamps may never be written, so skip them. The queries are reset once the
+    // slot is reused, after its submissions have completed.
+    frame->pending = true;
+    if (!recorded) {
+        profiler_discard(&engine->profiler, slot);
+        retire_frame(engine, slot);
+    }
+    return recorded;
+}
+
+bool submit_staged_frame(struct Haar2DEngine* engine, const struct VkStagingSlice* slice) {
+    const uint32_t slot = engine->frame_index;
+    struct Haar2DFrame* frame = &engine->frames[slot];
+    struct VkContext* context = engine->context;
+    const uint32_t num_planes = engine->num_planes;
+    const uint32_t compute_family = context->queues[QUEUE_COMPUTE].family;
+    const uint32_t transfer_family = context->queues[QUEUE_TRANSFER].family;
+
+    if (frame->pending) {
+        retire_frame(engine, slot);
+    }
+    engine->frame_index = (slot + 1) % engine->config.frames_in_flight;
+    engine->output = frame->planes[0].output;
+    profiler_reset(&engine->profiler, slot);
+    if (engine->config.linear_buffers) {
+        return submit_linear_frame(engine, slot, slice);
+    }
+
+    // Frames that aren't copied on the transfer queue are either converted or copied on the compute queue.
+    const bool convert = engine->config.input != HAAR2D_INPUT_RGBA && !engine->config.planar;
+    const VkAccessFlagBits upload_access = convert ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+    const VkPipelineStageFlagBits upload_stage =
+        convert ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    // The previous frame has completed and the images are overwritten entirely, so their contents
+    // are discarded instead of handing them back from the queues that used them last.
+    bool recorded = slice != NULL;
+    uint64_t point = 0;
+    VkCommandBuffer cmdbuf;
+    if (recorded && engine->transfer_upload) {
+        cmdbuf = frame->upload_cmdbuf;
+        begin_commands(cmdbuf);
+        for (uint32_t i = 0; i < num_planes; i++) {
+            struct VkTexture* texture = &frame->planes[i].texture;
+            texture->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            transition_layout(cmdbuf, texture, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE, VK_ACCESS_TRANSFER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        }
+        record_upload(engine, frame, cmdbuf, slice);
+        for (uint32_t i = 0; i < num_planes; i++) {
+            release_ownership(cmdbuf, &frame->planes[i].texture, transfer_family, compute_family,
+                              VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        }
+        vkEndCommandBuffer(cmdbuf);
+        point = submit_commands(context, QUEUE_TRANSFER, &cmdbuf, 1U, 0U, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+    }
+
+    // Run the transform on the compute queue once the upload is done.
+    if (recorded) {
+        cmdbuf = frame->cmdbuf;
+        begin_commands(cmdbuf);
+        for (uint32_t i = 0; i < num_planes; i++) {
+            struct Haar2DPlane* plane = &frame->planes[i];
+            if (engine->transfer_upload) {
+                acquire_ownership(cmdbuf, &plane->texture, transfer_family, compute_family,
+                                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            } else {
+                plane->texture.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                transition_layout(cmdbuf, &plane->texture, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE, upload_access,
+                                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, upload_stage);
+            }
+            if (plane->output == &plane->texture_de) {
+                plane->texture_de.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                transition_layout(cmdbuf, &plane->texture_de, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE,
+                                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                  VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+        }
+        if (!engine->transfer_upload) {
+            // The frame is read from the staging ring as part of the transform.
+            record_upload(engine, frame, cmdbuf, slice);
+            for (uint32_t i = 0; i < num_planes; i++) {
+                transition_layout(cmdbuf, &frame->planes[i].texture, VK_IMAGE_LAYOUT_GENERAL, upload_access,
+                                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                  upload_stage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+        }
+
+        record_passes(engine, frame, cmdbuf);
+
+        for (uint32_t i = 0; i < num_planes; i++) {
+            release_ownership(cmdbuf, frame->planes[i].output, compute_family, transfer_family,
+                              VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+        vkEndCommandBuffer(cmdbuf);
+        point = submit_commands(context, QUEUE_COMPUTE, &cmdbuf, 1U, point,
+                                VK_NULL_HANDLE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_NULL_HANDLE);
+
+        // Copy the coefficients to the staging ring and make them visible to the host.
+        cmdbuf = frame->readback_cmdbuf;
+        begin_commands(cmdbuf);
+        for (uint32_t i = 0; i < num_planes; i++) {
+            acquire_ownership(cmdbuf, frame->planes[i].output, compute_family, transfer_family,
+                              VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        }
+        profiler_begin(cmdbuf, &engine->profiler, "readback");
+        for (uint32_t i = 0; i < num_planes && recorded; i++) {
+            struct Haar2DPlane* plane = &frame->planes[i];
+            recorded = download_image_data(cmdbuf, plane->output, &plane->readback);
+        }
+        profiler_end(cmdbuf, &engine->profiler);
+
+        const VkMemoryBarrier host_barrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = NULL,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             1U, &host_barrier, 0U, NULL, 0U, NULL);
+        vkEndCommandBuffer(cmdbuf);
+        point = submit_commands(context, QUEUE_TRANSFER, &cmdbuf, recorded ? 1U : 0U, point,
+                                VK_NULL_HANDLE, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_NULL_HANDLE);
+    } else {
+        point = submit_commands(context, QUEUE_TRANSFER, NULL, 0U, 0U, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+    }
+
+    // Submit even if a staging slice was missing so the frame still closes and gets a timeline
+    // point, the results are simply never fetched. Timestamps of commands that never ran are dropped.
+    frame->value = point;
+
+    // Keep the readback slices alive after the submission completes until they have been fetched.
+    // When the ring can't hold them the result is dropped like that of a frame that wasn't recorded.
+    if (!staging_end_frame(&context->staging, frame->value, true)) {
+        recorded = false;
+    }
+    // Some of the timestamps may never be written, so skip them. The queries are reset once the
+    // slot is reused, after its submissions have completed.
+    frame->pending = true;
+    if (!recorded) {
+        profiler_discard(&engine->profiler, slot);
+        retire_frame(engine, slot);
+    }
+    return recorded;
+}
+
+bool acquire_result(struct Haar2DEngine* engine, bool wait, struct Haar2DResult* out_result) {
+    // Frames are submitted in order, so the oldest pending one is the first after the next slot.
+    const uint32_t num_frames = engine->config.frames_in_flight;
+    for (uint32_t i = 0; i < num_frames; i++) {
+        const uint32_t slot = (engine->frame_index + i) % num_frames;
+        const struct Haar2DFrame* frame = &engine->frames[slot];
+        if (!frame->pending) {
+            continue;
+        }
+
+        // The readback slices stay valid until the frame is retired.
+        if (wait) {
+            timeline_wait(engine->context, frame->value);
+        } else if (!timeline_reached(engine->context, frame->value)) {
+            return false;
+        }
+        out_result->value = frame->value;
+        out_result->num_planes = engine->num_planes;
+        out_result->slot = slot;
+        for (uint32_t j = 0; j < engine->num_planes; j++) {
+            out_result->planes[j] = frame->planes[j].readback.data;
+            out_result->plane_sizes[j] = (uint32_t)frame->planes[j].readback.size;
+        }
+        return true;
+    }
+    return false;
+}
+
+void release_result(struct Haar2DEngine* engine, const struct Haar2DResult* result) {
+    const struct Haar2DFrame* frame = &engine->frames[result->slot];
+    if (frame->pending && frame->value == result->value) {
+        retire_frame(engine, result->slot);
+    }
+}
+
+bool fetch_coefficients(struct Haar2DEngine* engine, uint8_t* out_data, uint32_t size) {
+    struct Haar2DResult result;
+    if (!acquire_result(engine, true, &result)) {
+        printf("No frame has been submitted to fetch coefficients from\n");
+        return false;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < result.num_planes && offset < size; i++) {
+        const uint32_t plane_size = result.plane_sizes[i];
+        memcpy(out_data + offset, result.planes[i], size - offset < plane_size ? size - offset : plane_size);
+        offset += plane_size;
+    }
+    release_result(engine, &result);
+    return true;
+}
+
+void destroy_engine(struct Haar2DEngine* engine) {
+    const VkDevice device = engine->context->device;
+    for (uint32_t i = 0; i < engine->config.frames_in_flight; i++) {
+        if (engine->frames[i].pending) {
+            retire_frame(engine, i);
+        }
+    }
+    for (uint32_t i = 0; i < HAAR2D_MAX_IMPORTS; i++) {
+        if (engine->imports[i].data) {
+            release_host_import(device, &engine->imports[i].import);
+        }
+    }
+
+    destroy_profiler(&engine->profiler);
+    vkDestroyCommandPool(device, engine->command_pool, NULL);
+    vkDestroyCommandPool(device, engine->transfer_pool, NULL);
+    vkDestroyDescriptorPool(device, engine->desc_pool, NULL);
+    destroy_pipeline(&engine->pipeline);
+    if (engine->config.input != HAAR2D_INPUT_RGBA && !engine->config.planar) {
+        destroy_pipeline(&engine->convert_pipeline);
+        vkDestroyDescriptorSetLayout(device, engine->convert_layout, NULL);
+    }
+    if (engine->config.linear_buffers) {
+        vkDestroyDescriptorSetLayout(device, engine->buffer_layout, NULL);
+    }
+    const bool fused = engine->frames[0].planes[0].output == &engine->frames[0].planes[0].texture;
+    if (!fused_kernel(&engine->config) && !separate_coefficients(&engine->config)) {
+        destroy_pipeline(&engine->d_pipeline);
+    }
+    for (uint32_t i = 0; i < engine->config.frames_in_flight && !engine->config.linear_buffers; i++) {
+        for (uint32_t j = 0; j < engine->num_planes; j++) {
+            destroy_texture(&engine->frames[i].planes[j].texture);
+            if (!fused) {
+                destroy_texture(&engine->frames[i].planes[j].texture_de);
+            }
+        }
+    }
+
+    if (engine->owns_context) {
+        destroy_context(engine->context);
+        free(engine->context);
+    }
+}
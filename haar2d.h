@@ -0,0 +1,254 @@
+#pragma once
+
+#include <volk.h>
+#include <stdbool.h>
+#include "vk_device.h"
+#include "vk_image.h"
+#include "vk_pipeline.h"
+#include "vk_profiler.h"
+
+#define HAAR2D_MAX_LEVELS 6
+#define HAAR2D_MAX_FRAMES MAX_PROFILER_SLOTS
+#define HAAR2D_MAX_PLANES 3
+#define HAAR2D_MAX_IMPORTS 16
+
+enum Haar2DKernel {
+    // Workgroups transform a block cooperatively in shared memory.
+    HAAR2D_KERNEL_TILED,
+    // Each invocation transforms a whole block on its own, directly on the image.
+    HAAR2D_KERNEL_SERIAL,
+    // Like the tiled kernel but runs every level and writes the subbands in a single dispatch,
+    // in place, without a separate deinterleave pass and image.
+    HAAR2D_KERNEL_FUSED,
+    // Like the fused kernel but the horizontal Haar steps exchange texels between subgroup lanes
+    // with shuffles instead of shared memory. Falls back to the fused kernel on devices that
+    // can't shuffle in compute shaders or whose subgroups don't evenly divide the workgroups.
+    HAAR2D_KERNEL_SUBGROUP,
+};
+
+// Wavelets the lifting steps can implement. The longer ones extend the samples symmetrically at the
+// edges of each block, since blocks are transformed independently.
+enum Haar2DWavelet {
+    HAAR2D_WAVELET_HAAR,
+    // LeGall 5/3, the reversible wavelet of JPEG 2000 and VC-2.
+    HAAR2D_WAVELET_LEGALL_5_3,
+    // Deslauriers-Dubuc 9/7 of VC-2, which predicts from four samples instead of two.
+    HAAR2D_WAVELET_DD_9_7,
+    // CDF 9/7, the irreversible wavelet of JPEG 2000. It has no integer form for lossless engines.
+    HAAR2D_WAVELET_CDF_9_7,
+};
+
+enum Haar2DDirection {
+    // Turns frames into subband coefficients.
+    HAAR2D_FORWARD,
+    // Reconstructs frames from subband coefficients produced by the forward transform.
+    HAAR2D_INVERSE,
+};
+
+enum Haar2DInput {
+    // Interleaved 8-bit RGBA pixels.
+    HAAR2D_INPUT_RGBA,
+    // Planar YUV with the planes stored back to back, as in raw video and Y4M frames. Unless the
+    // engine is planar, the planes are converted on the GPU with Y, Cb and Cr transformed in the
+    // first three channels of an RGBA image.
+    HAAR2D_INPUT_YUV420,
+    HAAR2D_INPUT_YUV422,
+    HAAR2D_INPUT_YUV444,
+    // A luma plane only.
+    HAAR2D_INPUT_GRAY,
+};
+
+struct Haar2DConfig {
+    uint32_t width;
+    uint32_t height;
+    // Layout of the frames passed to the engine, defaults to RGBA.
+    enum Haar2DInput input;
+    // Transforms each plane of YUV input in a single channel image of its own size instead of
+    // converting the frame to RGBA, which cuts the memory traffic by 2-4x depending on the chroma
+    // subsampling. The coefficients come back in the input layout rather than as RGBA.
+    bool planar;
+    // Bits per sample of planar input, 8 or 16, defaults to 8. 16-bit samples are little endian,
+    // which is how Y4M stores anything deeper than 8 bits.
+    uint32_t bit_depth;
+    enum Haar2DKernel kernel;
+    // Defaults to Haar. The other wavelets need a kernel that keeps blocks in shared memory, so
+    // they can't run on the serial kernel.
+    enum Haar2DWavelet wavelet;
+    enum Haar2DDirection direction;
+    // Number of dyadic decomposition levels, defaults to 1. Each level transforms the low-pass
+    // band of the previous one, so 2^levels must not exceed block_dim.
+    uint32_t levels;
+    // Size of the independently transformed square blocks, defaults to 32. The tiled and fused
+    // kernels keep a whole block in shared memory, larger sizes fall back to the serial kernel, as
+    // do blocks that exceed the device's shared memory or workgroup size. Frames that don't divide
+    // into blocks are transformed in one dispatch like the fused kernel, with the partial blocks at
+    // their edges extended by zeros, so block_dim is limited the same way.
+    uint32_t block_dim;
+    // Runs integer lifting steps instead of float ones, so the inverse reconstructs the input bit
+    // for bit. Haar becomes the S-transform, d = b - a and s = a + floor(d / 2), and the longer
+    // wavelets use the rounding of VC-2. Needs RGBA or planar input, and the coefficients are
+    // signed 16-bit integers, 32-bit for 16-bit samples. Every level runs in one dispatch like the
+    // fused kernel, so block_dim is limited the same way. On devices with shaderInt16, 16-bit
+    // coefficients are also kept in 16-bit shared memory while lifting.
+    bool lossless;
+    // Stores the coefficients of float transforms as 16-bit floats, R16G16B16A16_SFLOAT or
+    // R16_SFLOAT for planar engines, instead of the normalized sample format, which clamps the
+    // signed high-pass bands and loses precision on every level. Like lossless transforms, the
+    // samples and coefficients live in separate images and every level runs in one dispatch
+    // whatever the kernel. On devices with shaderFloat16 the lifting runs in float16_t as well.
+    bool half_coefficients;
+    // Reads frames straight from the staging ring and writes the coefficients straight to their
+    // readback slice, both as linear storage buffers, instead of copying them to and from images.
+    // Frames and coefficients keep the layout of the image path, with rows of width texels. Only
+    // float transforms of RGBA frames whose width is a multiple of 4 are supported, every level
+    // runs in one dispatch and there is no image for record_transform to leave the result in.
+    bool linear_buffers;
+    // Collects GPU timings of every stage in engine->profiler.
+    bool profile;
+    // Number of frames that can be recorded before the first one has to complete, defaults to 1.
+    // Every frame in flight has its own images, descriptor sets and command buffer.
+    uint32_t frames_in_flight;
+};
+
+// Images of one plane of a frame in flight. RGBA and converted YUV frames have a single plane.
+struct Haar2DPlane {
+    struct VkTexture texture;
+    struct VkTexture texture_de;
+    // Image holding the result, either texture_de or texture for the fused kernel.
+    struct VkTexture* output;
+    VkDescriptorSet desc_set;
+    VkDescriptorSet desc_set_2;
+    struct VkStagingSlice readback;
+};
+
+// Resources of one frame in flight.
+struct Haar2DFrame {
+    struct Haar2DPlane planes[HAAR2D_MAX_PLANES];
+    // Reads YUV input from the staging ring into the RGBA texture of the first plane.
+    VkDescriptorSet convert_set;
+    // Frame and coefficient slices of the staging ring, for engines with linear buffers.
+    VkDescriptorSet buffer_set;
+    // Transform on the compute queue, surrounded by the upload and readback on the transfer queue.
+    VkCommandBuffer cmdbuf;
+    VkCommandBuffer upload_cmdbuf;
+    VkCommandBuffer readback_cmdbuf;
+    // Timeline point of the pending readback.
+    uint64_t value;
+    bool initialized;
+    bool pending;
+};
+
+// Host allocation submit_host_frame imported. Callers recycle their frame buffers, so imports are
+// kept until the engine is destroyed or the entry is needed for another allocation.
+struct Haar2DImport {
+    // NULL for an unused entry.
+    const uint8_t* data;
+    uint32_t size;
+    struct VkHostImport import;
+    // Timeline point of the last frame uploaded from it.
+    uint64_t value;
+};
+
+// Coefficients of a completed frame, read in place from its readback slices in the staging ring.
+struct Haar2DResult {
+    // Timeline point the frame completed at.
+    uint64_t value;
+    uint32_t num_planes;
+    const uint8_t* planes[HAAR2D_MAX_PLANES];
+    uint32_t plane_sizes[HAAR2D_MAX_PLANES];
+    // Frame in flight holding the slices.
+    uint32_t slot;
+};
+
+// Owns everything needed to run the haar transform on frames of a fixed size.
+struct Haar2DEngine {
+    struct VkContext* context;
+    bool owns_context;
+    struct Haar2DConfig config;
+    struct Haar2DFrame frames[HAAR2D_MAX_FRAMES];
+    struct Haar2DImport imports[HAAR2D_MAX_IMPORTS];
+    // Frame the next transform is recorded to.
+    uint32_t frame_index;
+    uint32_t num_planes;
+    // Offset of each plane in an input frame.
+    uint32_t plane_offsets[HAAR2D_MAX_PLANES];
+    // Whether frames are copied to the images on the transfer queue. Dedicated transfer queues
+    // can only copy from 4 byte aligned offsets, which odd sized planes don't always start at.
+    bool transfer_upload;
+    // Image holding the result of the first plane of the most recently recorded transform, NULL for
+    // engines with linear buffers.
+    struct VkTexture* output;
+    struct VkCompPipeline pipeline;
+    struct VkCompPipeline d_pipeline;
+    struct VkCompPipeline convert_pipeline;
+    VkDescriptorSetLayout convert_layout;
+    VkDescriptorSetLayout buffer_layout;
+    VkDescriptorPool desc_pool;
+    // Pools of the compute and transfer queue families.
+    VkCommandPool command_pool;
+    VkCommandPool transfer_pool;
+    struct VkProfiler profiler;
+};
+
+// Creates an engine on the provided context. When context is NULL the engine creates and owns
+// a headless context of its own.
+bool create_engine(struct Haar2DEngine* out_engine, struct VkContext* context, const struct Haar2DConfig* config);
+
+// Size in bytes of one input frame in the configured input layout. Coefficients, the input of the
+// inverse transform, fill whole blocks, so each plane is padded up to a multiple of block_dim.
+uint32_t input_frame_size(const struct Haar2DConfig* config);
+
+// Size in bytes of the coefficients of a frame, RGBA unless the engine is planar, and padded to
+// whole blocks like the input of the inverse transform.
+uint32_t output_frame_size(const struct Haar2DConfig* config);
+
+// Records the upload of a frame in the configured input layout followed by the transform into a
+// caller provided command buffer of the graphics queue, using the resources of the next frame in
+// flight. The caller must make sure the transform recorded frames_in_flight calls earlier has
+// completed. The coefficients, or the reconstructed frame for the inverse transform, are left in
+// engine->output in general layout. The upload is staged in the context's staging ring, so the
+// caller must close the frame with staging_end_frame after submitting it. An engine must use
+// either record_transform or submit_frame since they leave the images owned by different queue
+// families. Returns false without recording anything when the frame can't be staged, engine->output
+// then still holds the previous result.
+bool record_transform(struct Haar2DEngine* engine, VkCommandBuffer cmdbuf, const uint8_t* data, uint32_t size);
+
+// Uploads and reads back an RGBA frame on the transfer queue and transforms it on the compute queue,
+// handing the images over between them. Returns without waiting for the GPU, use fetch_coefficients
+// to retrieve the result. Once frames_in_flight frames are pending, this waits for the oldest one and
+// discards its result if it wasn't fetched. Returns false when the frame has no result to fetch,
+// because it couldn't be staged or the staging ring couldn't hold its readback.
+bool submit_frame(struct Haar2DEngine* engine, const uint8_t* data, uint32_t size);
+
+// Same as submit_frame, but imports the caller's frame as device memory and uploads it from there
+// instead of copying it to the staging ring first. size is that of the allocation at data, which
+// must be at least input_frame_size and, like data, a multiple of the context's
+// host_import_alignment. The allocation must stay untouched until the frame has been fetched or
+// discarded, and allocated until the engine is destroyed, since the import is cached by address
+// and reused when the same buffer is submitted again. Falls back to submit_frame when the device
+// can't import it or the engine reads its frames through descriptors of the staging ring, as YUV
+// conversion and linear buffers do.
+bool submit_host_frame(struct Haar2DEngine* engine, uint8_t* data, uint32_t size);
+
+// Hands out a staging slice of input_frame_size bytes for the next frame, so the caller can produce
+// the frame directly in staging memory instead of copying it there. The slice must be passed to
+// submit_staged_frame before any other frame is submitted.
+bool stage_frame(struct Haar2DEngine* engine, struct VkStagingSlice* out_slice);
+
+// Same as submit_frame for a frame the caller wrote to a slice from stage_frame.
+bool submit_staged_frame(struct Haar2DEngine* engine, const struct VkStagingSlice* slice);
+
+// Hands out the coefficients of the oldest pending frame without copying them. Unless wait is set,
+// returns false right away if that frame hasn't completed yet, or if no frame is pending. The
+// pointers stay valid until release_result, which must come before frames_in_flight more frames
+// are submitted. Until then the same frame is handed out again.
+bool acquire_result(struct Haar2DEngine* engine, bool wait, struct Haar2DResult* out_result);
+
+// Gives the readback slices of an acquired result back to the staging ring.
+void release_result(struct Haar2DEngine* engine, const struct Haar2DResult* result);
+
+// Waits for the oldest pending frame and copies its coefficients to out_data. For the inverse
+// transform these are the pixels of the reconstructed frame. Planes are stored back to back.
+bool fetch_coefficients(struct Haar2DEngine* engine, uint8_t* out_data, uint32_t size);
+
+void destroy_engine(struct Haar2DEngine* engine);
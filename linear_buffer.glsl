@@ -0,0 +1,47 @@
+// Frames and coefficients of linear buffer engines, read from and written to the staging ring as
+// storage buffers. Frame rows are width texels long and width is a multiple of 4, so every row starts
+// 16 byte aligned and a uvec4 word holds 4 texels of 8-bit RGBA or 2 texels of 16-bit float RGBA.
+// Coefficients fill whole blocks, so their rows and columns are padded up to a multiple of block_dim.
+// The including shader declares block_dim, width and height.
+
+layout (set = 0, binding = 0, std430) readonly buffer SrcBuffer {
+    uvec4 src_words[];
+};
+layout (set = 0, binding = 1, std430) writeonly buffer DstBuffer {
+    uvec4 dst_words[];
+};
+
+const int FORMAT_UNORM8 = 0;
+const int FORMAT_FLOAT16 = 1;
+
+int texels_per_word(int texel_format) {
+    return texel_format == FORMAT_FLOAT16 ? 2 : 4;
+}
+
+const int padded_width = (width + block_dim - 1) / block_dim * block_dim;
+
+bool in_frame(ivec2 pos) {
+    return all(lessThan(pos, ivec2(width, height)));
+}
+
+// Index of the word holding the texel at pos in rows of row_length texels, pos must be the first
+// texel of a word.
+int word_index(ivec2 pos, int row_length, int texel_format) {
+    return (pos.y * row_length + pos.x) / texels_per_word(texel_format);
+}
+
+vec4 unpack_texel(uvec4 word, int i, int texel_format) {
+    if (texel_format == FORMAT_FLOAT16) {
+        return vec4(unpackHalf2x16(word[2 * i]), unpackHalf2x16(word[2 * i + 1]));
+    }
+    return unpackUnorm4x8(word[i]);
+}
+
+void pack_texel(inout uvec4 word, int i, vec4 texel, int texel_format) {
+    if (texel_format == FORMAT_FLOAT16) {
+        word[2 * i] = packHalf2x16(texel.xy);
+        word[2 * i + 1] = packHalf2x16(texel.zw);
+    } else {
+        word[i] = packUnorm4x8(texel);
+    }
+}
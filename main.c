@@ -1,26 +1,291 @@
 #include <volk.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include "vk_device.h"
 #include "vk_swapchain.h"
-#include "vk_image.h"
-#include "vk_pipeline.h"
-#include "stb_image.h"
-#include "haar2d_hor_comp_spv.h"
-#include "deinterleave_comp_spv.h"
+#include "haar2d.h"
+#include "frame_source.h"
+#include "yuv_reader.h"
 #include <GLFW/glfw3.h>
 
 #define WIDTH 800
 #define HEIGHT 600
-#define MAX_FRAMES 6
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+// Images the headless runs keep queued on the engine before fetching the oldest one.
+#define HEADLESS_FRAMES_IN_FLIGHT 2
 
 struct Vec2i {
     int32_t x;
     int32_t y;
 };
 
-int main() {
+// Runs the coefficients of a lossless transform through the inverse and compares the result with the
+// frame they came from, which must match bit for bit.
+static bool verify_round_trip(struct Haar2DEngine* inverse, const uint8_t* coefficients, const uint8_t* frame,
+                              uint8_t* reconstructed) {
+    const uint32_t size = output_frame_size(&inverse->config);
+    if (!submit_frame(inverse, coefficients, input_frame_size(&inverse->config)) ||
+        !fetch_coefficients(inverse, reconstructed, size)) {
+        return false;
+    }
+
+    uint32_t num_mismatches = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        num_mismatches += reconstructed[i] != frame[i];
+    }
+    if (num_mismatches > 0) {
+        printf("Round trip changed %u of %u samples\n", num_mismatches, size);
+    }
+    return num_mismatches == 0;
+}
+
+// Runs the transform over every image in the list without creating a window or a swapchain and
+// reads the coefficients back to host memory. With verify, lossless coefficients are also run
+// through the inverse transform and checked against the image.
+static int run_headless(const char** paths, uint32_t num_paths, uint32_t levels, bool lossless, bool profile,
+                        bool verify) {
+    if (volkInitialize() != VK_SUCCESS) {
+        return 1;
+    }
+
+    struct VkContext context = {};
+    if (!create_context(&context, NULL, 0U)) {
+        return 1;
+    }
+
+    struct Haar2DEngine engine = {};
+    struct Haar2DEngine inverse = {};
+    bool engine_created = false;
+    uint8_t* coefficients = NULL;
+    uint8_t* reconstructed = NULL;
+    uint32_t num_processed = 0;
+    uint32_t num_failed = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Images are decoded ahead on background threads while the GPU works on the current one, into
+    // buffers the device can import when it supports that.
+    const uint32_t alignment = context.external_memory_host ? (uint32_t)context.host_import_alignment : 0U;
+    struct FrameSource source;
+    if (!create_frame_source(&source, paths, num_paths, 0U, 0U, alignment)) {
+        destroy_context(&context);
+        return 1;
+    }
+
+    // Images stay acquired until their coefficients have been fetched, since the GPU may read them
+    // in place, and go back in the order they were acquired. Up to frames_in_flight of them are
+    // queued on the engine so the transfers and the transform of consecutive images overlap.
+    const struct SourceFrame* pending[HEADLESS_FRAMES_IN_FLIGHT];
+    bool submitted[HEADLESS_FRAMES_IN_FLIGHT];
+    uint32_t first_pending = 0;
+    uint32_t num_pending = 0;
+
+    for (;;) {
+        const struct SourceFrame* frame = frame_source_acquire(&source);
+        const bool resized = frame && frame->width != 0 && engine_created &&
+                             (engine.config.width != frame->width || engine.config.height != frame->height);
+
+        // Fetch the oldest image when the queue is full, and every image before the engine goes away.
+        while (num_pending > 0 && (!frame || resized || num_pending == HEADLESS_FRAMES_IN_FLIGHT)) {
+            const struct SourceFrame* oldest = pending[first_pending];
+            if (submitted[first_pending]) {
+                fetch_coefficients(&engine, coefficients, output_frame_size(&engine.config));
+                if (verify && !verify_round_trip(&inverse, coefficients, oldest->data, reconstructed)) {
+                    printf("Round trip of %s failed\n", oldest->path);
+                    num_failed++;
+                }
+                num_processed++;
+            }
+            frame_source_release(&source, oldest);
+            first_pending = (first_pending + 1) % HEADLESS_FRAMES_IN_FLIGHT;
+            num_pending--;
+        }
+        if (!frame) {
+            break;
+        }
+
+        const uint32_t width = frame->width;
+        const uint32_t height = frame->height;
+        const uint32_t slot = (first_pending + num_pending) % HEADLESS_FRAMES_IN_FLIGHT;
+        pending[slot] = frame;
+        submitted[slot] = false;
+        num_pending++;
+        if (width == 0) {
+            continue;
+        }
+
+        // The engine is sized to the image, so recreate it whenever the resolution changes.
+        if (!engine_created || resized) {
+            if (engine_created) {
+                profiler_report(&engine.profiler);
+                destroy_engine(&engine);
+                if (verify) {
+                    destroy_engine(&inverse);
+                }
+            }
+            struct Haar2DConfig config = {
+                .width = width,
+                .height = height,
+                .levels = levels,
+                .lossless = lossless,
+                .profile = profile,
+                .frames_in_flight = HEADLESS_FRAMES_IN_FLIGHT,
+            };
+            engine_created = create_engine(&engine, &context, &config);
+            config.direction = HAAR2D_INVERSE;
+            config.profile = false;
+            config.frames_in_flight = 1;
+            if (engine_created && verify && !create_engine(&inverse, &context, &config)) {
+                destroy_engine(&engine);
+                engine_created = false;
+            }
+            if (!engine_created) {
+                continue;
+            }
+            coefficients = (uint8_t*)realloc(coefficients, output_frame_size(&engine.config));
+            reconstructed = verify ? (uint8_t*)realloc(reconstructed, width * height * 4) : NULL;
+        }
+
+        // The decoded frame is read in place when the device can import it.
+        submitted[slot] = submit_host_frame(&engine, frame->data, frame->capacity);
+        if (submitted[slot]) {
+            printf("Transformed %s (%ux%u)\n", frame->path, width, height);
+        } else {
+            printf("Unable to transform %s\n", frame->path);
+        }
+    }
+    const uint32_t num_frames = source.num_paths;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Processed %u images in %.3f seconds\n", num_processed, elapsed);
+    if (verify) {
+        printf("%u of %u round trips reconstructed the image exactly\n", num_processed - num_failed, num_processed);
+    }
+
+    // Cleanup. The engine may still have the frame buffers imported, so it goes first.
+    free(coefficients);
+    free(reconstructed);
+    if (engine_created) {
+        profiler_report(&engine.profiler);
+        destroy_engine(&engine);
+        if (verify) {
+            destroy_engine(&inverse);
+        }
+    }
+    destroy_frame_source(&source);
+    destroy_context(&context);
+    return num_processed == num_frames && num_failed == 0 ? 0 : 1;
+}
+
+// Streams raw or Y4M video through the transform. Frames are read from the file or pipe straight
+// into the staging ring and either converted to RGBA on the GPU or transformed plane by plane.
+// Samples deeper than 8 bits are always transformed plane by plane.
+static int run_headless_video(const char* path, const struct YuvFormat* raw_format, bool planar, uint32_t levels,
+                              bool lossless, bool profile) {
+    if (volkInitialize() != VK_SUCCESS) {
+        return 1;
+    }
+
+    struct YuvReader reader;
+    if (!open_yuv_reader(&reader, path, raw_format)) {
+        return 1;
+    }
+
+    struct VkContext context = {};
+    if (!create_context(&context, NULL, 0U)) {
+        close_yuv_reader(&reader);
+        return 1;
+    }
+
+    static const enum Haar2DInput inputs[] = {
+        [YUV_CHROMA_420] = HAAR2D_INPUT_YUV420,
+        [YUV_CHROMA_422] = HAAR2D_INPUT_YUV422,
+        [YUV_CHROMA_444] = HAAR2D_INPUT_YUV444,
+        [YUV_CHROMA_MONO] = HAAR2D_INPUT_GRAY,
+    };
+    const struct Haar2DConfig config = {
+        .width = reader.format.width,
+        .height = reader.format.height,
+        .input = inputs[reader.format.chroma],
+        .planar = planar || reader.format.bit_depth > 8,
+        .bit_depth = reader.format.bit_depth > 8 ? 16 : 8,
+        .levels = levels,
+        .lossless = lossless,
+        .profile = profile,
+        .frames_in_flight = HEADLESS_FRAMES_IN_FLIGHT,
+    };
+    struct Haar2DEngine engine = {};
+    if (!create_engine(&engine, &context, &config)) {
+        destroy_context(&context);
+        close_yuv_reader(&reader);
+        return 1;
+    }
+
+    uint32_t num_processed = 0;
+    uint32_t num_failed = 0;
+    bool stopped = false;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // The next frame is read while the previous ones are still on the GPU. Results are taken as soon
+    // as they are ready and only waited for once every frame in flight is pending. The coefficients
+    // are only looked at in place in the staging ring, never copied out.
+    struct VkStagingSlice slice;
+    struct Haar2DResult result;
+    uint32_t num_pending = 0;
+    for (;;) {
+        while (num_pending > 0 && acquire_result(&engine, num_pending == engine.config.frames_in_flight, &result)) {
+            release_result(&engine, &result);
+            num_pending--;
+        }
+        if (!stage_frame(&engine, &slice)) {
+            // Close the frame that couldn't be staged and stop, reporting it unlike the end of the stream.
+            printf("Unable to stage frame %u, stopping\n", reader.frame_index);
+            submit_staged_frame(&engine, NULL);
+            stopped = true;
+            break;
+        }
+        if (!yuv_read_frame(&reader, slice.data)) {
+            break;
+        }
+        if (!submit_staged_frame(&engine, &slice)) {
+            printf("Unable to transform frame %u\n", reader.frame_index - 1);
+            num_failed++;
+            continue;
+        }
+        num_pending++;
+        num_processed++;
+    }
+    while (num_pending > 0 && acquire_result(&engine, true, &result)) {
+        release_result(&engine, &result);
+        num_pending--;
+    }
+    // Results that were never handed out were dropped.
+    num_failed += num_pending;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Processed %u frames of %ux%u in %.3f seconds\n", num_processed - num_pending, config.width, config.height,
+           elapsed);
+    if (num_failed > 0) {
+        printf("%u frames failed\n", num_failed);
+    }
+
+    // Cleanup.
+    profiler_report(&engine.profiler);
+    destroy_engine(&engine);
+    destroy_context(&context);
+    close_yuv_reader(&reader);
+    return num_failed == 0 && !stopped ? 0 : 1;
+}
+
+static int run_viewer(uint32_t frames_in_flight, const char** paths, uint32_t num_paths) {
     glfwInit();
     if (!glfwVulkanSupported()) {
         glfwTerminate();
@@ -34,16 +299,37 @@ int main() {
     // Create context and window.
     struct VkContext context = {};
     struct VkWindow window = {};
-    struct VkTexture texture = {};
-    struct VkTexture texture_de = {};
-    struct VkCompPipeline pipeline = {};
-    struct VkCompPipeline d_pipeline = {};
-    create_context(&context);
-    create_window(&context, &window, WIDTH, HEIGHT);
-    create_texture(&context, &texture, WIDTH, HEIGHT, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM);
-    create_texture(&context, &texture_de, WIDTH, HEIGHT, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM);
-    create_pipeline(&context, &pipeline, texture.desc_layout, HAAR2D_HOR_COMP_SPV, sizeof(HAAR2D_HOR_COMP_SPV));
-    create_pipeline(&context, &d_pipeline, texture.desc_layout_2, DEINTERLEAVE_COMP_SPV, sizeof(DEINTERLEAVE_COMP_SPV));
+    struct Haar2DEngine engine = {};
+    uint32_t num_instance_extensions = 0;
+    const char** instance_extensions = glfwGetRequiredInstanceExtensions(&num_instance_extensions);
+    if (!create_context(&context, instance_extensions, num_instance_extensions)) {
+        glfwTerminate();
+        return 1;
+    }
+    create_window(&context, &window, WIDTH, HEIGHT, frames_in_flight);
+
+    // Every frame is transformed again, with its own images, so consecutive frames can overlap.
+    const struct Haar2DConfig config = {
+        .width = WIDTH,
+        .height = HEIGHT,
+        .frames_in_flight = frames_in_flight,
+    };
+    if (!create_engine(&engine, &context, &config)) {
+        destroy_window(&window);
+        destroy_context(&context);
+        glfwTerminate();
+        return 1;
+    }
+
+    // Frames are decoded in the background, the last one stays on screen once the sequence ends.
+    struct FrameSource source;
+    if (!create_frame_source(&source, paths, num_paths, 0U, 0U, 0U)) {
+        destroy_engine(&engine);
+        destroy_window(&window);
+        destroy_context(&context);
+        glfwTerminate();
+        return 1;
+    }
 
     // Make command pool to allocate command buffers.
     const VkCommandPoolCreateInfo command_pool_ci = {
@@ -60,49 +346,13 @@ int main() {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .commandPool = command_pool,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = window.num_images,
+        .commandBufferCount = window.num_frames,
     };
 
-    VkCommandBuffer buffers[MAX_FRAMES];
+    VkCommandBuffer buffers[HAAR2D_MAX_FRAMES];
     vkAllocateCommandBuffers(context.device, &buffer_alloc_info, buffers);
 
-    // Make a descriptor pool to allocate the storage image descriptors we need.
-    const VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 16};
-    const VkDescriptorPoolCreateInfo descriptor_pool_ci = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .maxSets = 8,
-        .poolSizeCount = 1U,
-        .pPoolSizes = &pool_size,
-    };
-
-    VkDescriptorPool desc_pool;
-    vkCreateDescriptorPool(context.device, &descriptor_pool_ci, NULL, &desc_pool);
-
-    // Allocate one descriptor for each frame.
-    VkDescriptorSetAllocateInfo allocate_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .pNext = NULL,
-        .descriptorPool = desc_pool,
-        .descriptorSetCount = 1U,
-        .pSetLayouts = &texture.desc_layout,
-    };
-
-    VkDescriptorSet desc_set;
-    vkAllocateDescriptorSets(context.device, &allocate_info, &desc_set);
-
-    VkDescriptorSet desc_set_2;
-    allocate_info.pSetLayouts = &texture.desc_layout_2;
-    vkAllocateDescriptorSets(context.device, &allocate_info, &desc_set_2);
-
-    // Update allocated sets with our image.
-    const struct VkTexture* textures[2] = {&texture, &texture_de};
-    write_as_storage_descriptor(desc_set, textures, 1U);
-    write_as_storage_descriptor(desc_set_2, textures, 2U);
-
-    // Load test image
-    int32_t width, height, num_channels;
-    uint8_t* data = stbi_load("ffmpeg_6.1.1.png", &width, &height, &num_channels, 0);
+    const struct SourceFrame* frame = NULL;
 
     const VkImageSubresourceRange range = {
         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
@@ -112,16 +362,37 @@ int main() {
         .layerCount = VK_REMAINING_ARRAY_LAYERS,
     };
 
-    bool texture_initialized = false;
     while (!glfwWindowShouldClose(window.window)) {
         glfwPollEvents();
 
+        // Feed a new frame every iteration. Frames must go back in the order they were acquired, so
+        // the previous one is released first, even when the new one can't be shown.
+        const struct SourceFrame* next = frame_source_acquire(&source);
+        if (next) {
+            if (frame) {
+                frame_source_release(&source, frame);
+            }
+            frame = next;
+            if (frame->width != 0 && (frame->width != WIDTH || frame->height != HEIGHT)) {
+                printf("Skipping %s, only %ux%u frames are shown\n", frame->path, WIDTH, HEIGHT);
+            }
+        }
+
+        // Frames of a different size than the window are held without being shown, the last
+        // presented image stays on screen. Once the sequence is over there is nothing left to
+        // acquire, so block on window events instead of spinning.
+        if (!frame || frame->width != WIDTH || frame->height != HEIGHT) {
+            if (!next) {
+                glfwWaitEvents();
+            }
+            continue;
+        }
+
         // Retrieve command buffer for this loop.
         VkCommandBuffer cmdbuf = buffers[window.frame_index];
 
-        // Wait for the fence signaled on queue submit. This ensures our command buffer is free to use.
-        vkWaitForFences(context.device, 1U, &window.fences[window.frame_index], VK_FALSE, UINT64_MAX);
-        vkResetFences(context.device, 1U, &window.fences[window.frame_index]);
+        // Wait for the last submission of this frame. This ensures our command buffer is free to use.
+        timeline_wait(&context, window.frame_values[window.frame_index]);
 
         // Acquire a new swapchain image to draw on
         acquire_next_image(&window);
@@ -134,46 +405,14 @@ int main() {
         };
         vkBeginCommandBuffer(cmdbuf, &begin_info);
 
-        // Transition from undefined to general and upload pixel data in the first frame.
-        if (!texture_initialized) {
-            transition_layout(cmdbuf, &texture, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE, VK_ACCESS_NONE,
-                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
-            transition_layout(cmdbuf, &texture_de, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_NONE, VK_ACCESS_NONE,
-                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
-
-            // Upload test image to vulkan image.
-            upload_image_data(cmdbuf, data, width * height * num_channels, &texture);
-
-            transition_layout(cmdbuf, &texture, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT,
-                              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
-                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-
-            // Bind descriptor sets and pipeline.
-            vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0U, 1U,
-                                    &desc_set, 0U, NULL);
-            vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
-
-            uint32_t width = WIDTH / 8;
-            uint32_t height = HEIGHT / 8;
-            for (uint32_t i = 0; i < 1; i++) {
-                struct PushConstants con = {.block_dim = 32, .level = i};
-                vkCmdPushConstants(cmdbuf, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0U, sizeof(con), &con);
-                vkCmdDispatch(cmdbuf, width, height, 1);
-            }
-
-            // Bind descriptor sets and pipeline.
-            vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, d_pipeline.layout, 0U, 1U,
-                                    &desc_set_2, 0U, NULL);
-            vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, d_pipeline.pipeline);
-            struct PushConstants con = {.block_dim = 32, .level = 0};
-            vkCmdPushConstants(cmdbuf, d_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0U, sizeof(con), &con);
-            vkCmdDispatch(cmdbuf, width, height, 1);
-
-            texture_initialized = true;
-        }
+        // Upload pixel data and run the transform on the resources of this frame. The wait above
+        // also guards the engine frame, both rotate through the same number of frames, and the
+        // engine skips its frame too when the upload can't be staged, showing the previous result
+        // again. Everything stays on the graphics queue since the result is blitted right after.
+        const bool staged = record_transform(&engine, cmdbuf, frame->data, WIDTH * HEIGHT * 4);
 
         // Transition swapchain image to transfer dest layout for clearing.
-        struct VkTexture* display_tex = &texture_de;
+        struct VkTexture* display_tex = engine.output;
         VkImageMemoryBarrier image_barriers[2] = {
             // Image barrier for the swapchain image.
             [0] = {
@@ -184,7 +423,7 @@ int main() {
                 .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                 .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
                 .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-                .image = window.images[window.frame_index],
+                .image = window.images[window.image_index],
                 .subresourceRange = range,
             },
             // Image barrier for the storage image.
@@ -223,7 +462,7 @@ int main() {
             .dstOffsets = {{0, 0, 0}, {WIDTH, HEIGHT, 1}},
         };
         vkCmdBlitImage(cmdbuf, display_tex->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       window.images[window.frame_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       window.images[window.image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                        1U, &image_copy, VK_FILTER_NEAREST);
 
         // Transition to presentation layout after we are done.
@@ -244,37 +483,112 @@ int main() {
         // End command buffer and submit.
         vkEndCommandBuffer(cmdbuf);
 
-        const VkPipelineStageFlags wait_flags = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-        const VkSubmitInfo submit_info = {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .pNext = NULL,
-            .waitSemaphoreCount = 1U,
-            .pWaitSemaphores = &window.image_acquired[window.frame_index],
-            .pWaitDstStageMask = &wait_flags,
-            .commandBufferCount = 1U,
-            .pCommandBuffers = &cmdbuf,
-            .signalSemaphoreCount = 1U,
-            .pSignalSemaphores = &window.present_ready[window.frame_index],
-        };
-        vkQueueSubmit(context.queue, 1U, &submit_info, window.fences[window.frame_index]);
+        const uint64_t value = submit_commands(&context, QUEUE_GRAPHICS, &cmdbuf, 1U, 0U,
+                                               window.image_acquired[window.frame_index],
+                                               VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                                               window.present_ready[window.image_index]);
+        window.frame_values[window.frame_index] = value;
+
+        // The upload slice is recycled once this submission has completed.
+        if (staged) {
+            staging_end_frame(&context.staging, value, false);
+        }
 
         // Present
         present(&window);
     }
 
-    // Wait for all the fences to ensure all command buffers have finished execution.
-    vkWaitForFences(context.device, window.num_images, window.fences, VK_TRUE, UINT64_MAX);
-    vkDestroyDescriptorPool(context.device, desc_pool, NULL);
+    // Wait for the last submission to ensure all command buffers have finished execution.
+    timeline_wait(&context, TIMELINE_POINT(QUEUE_GRAPHICS, context.queues[QUEUE_GRAPHICS].last_submitted));
     vkDestroyCommandPool(context.device, command_pool, NULL);
-    stbi_image_free(data);
+    destroy_frame_source(&source);
 
     // Cleanup.
-    destroy_pipeline(&pipeline);
-    destroy_pipeline(&d_pipeline);
-    destroy_texture(&texture);
-    destroy_texture(&texture_de);
+    destroy_engine(&engine);
     destroy_window(&window);
     destroy_context(&context);
     glfwTerminate();
     return 0;
 }
+
+int main(int argc, const char** argv) {
+    // Usage: haar2d-vulkan [--frames N | --headless [--levels N] [--lossless [--verify]] [--profile]]
+    //                      [image|directory...]
+    //        haar2d-vulkan --headless [--levels N] [--lossless] [--profile] [--planar]
+    //                      [--raw WxH[:420|422|444|mono[p10|p16]]] video.y4m|video.yuv|-
+    static const char* default_image = "ffmpeg_6.1.1.png";
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        int arg = 2;
+        uint32_t levels = 1;
+        bool lossless = false;
+        bool profile = false;
+        bool raw = false;
+        bool planar = false;
+        bool verify = false;
+        struct YuvFormat raw_format = {.chroma = YUV_CHROMA_420, .bit_depth = 8};
+        for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+            if (strcmp(argv[arg], "--levels") == 0 && arg + 1 < argc) {
+                levels = (uint32_t)atoi(argv[++arg]);
+            } else if (strcmp(argv[arg], "--lossless") == 0) {
+                lossless = true;
+            } else if (strcmp(argv[arg], "--profile") == 0) {
+                profile = true;
+            } else if (strcmp(argv[arg], "--verify") == 0) {
+                verify = true;
+            } else if (strcmp(argv[arg], "--planar") == 0) {
+                planar = true;
+            } else if (strcmp(argv[arg], "--raw") == 0 && arg + 1 < argc) {
+                const char* chroma = strchr(argv[++arg], ':');
+                raw = sscanf(argv[arg], "%ux%u", &raw_format.width, &raw_format.height) == 2 &&
+                      (!chroma || parse_yuv_chroma(chroma + 1, &raw_format));
+                if (!raw) {
+                    printf("Invalid raw frame format %s\n", argv[arg]);
+                    return 1;
+                }
+            } else {
+                printf("Unknown option %s\n", argv[arg]);
+                return 1;
+            }
+        }
+
+        // Only lossless coefficients are expected to reconstruct the input exactly.
+        if (verify && !lossless) {
+            printf("--verify checks the round trip of lossless transforms, it needs --lossless\n");
+            return 1;
+        }
+
+        // Video is streamed from a single file or stdin, anything else is a list of images.
+        const char* extension = arg + 1 == argc ? strrchr(argv[arg], '.') : NULL;
+        if (raw || (arg + 1 == argc && strcmp(argv[arg], "-") == 0) ||
+            (extension && (strcmp(extension, ".y4m") == 0 || strcmp(extension, ".yuv") == 0))) {
+            if (arg + 1 != argc) {
+                printf("Video input takes a single file\n");
+                return 1;
+            }
+            if (verify) {
+                printf("--verify only checks the round trip of images\n");
+                return 1;
+            }
+            return run_headless_video(argv[arg], raw ? &raw_format : NULL, planar, levels, lossless, profile);
+        }
+        if (arg == argc) {
+            return run_headless(&default_image, 1U, levels, lossless, profile, verify);
+        }
+        return run_headless(argv + arg, argc - arg, levels, lossless, profile, verify);
+    }
+
+    uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+    int arg = 1;
+    if (argc > 2 && strcmp(argv[1], "--frames") == 0) {
+        frames_in_flight = (uint32_t)atoi(argv[2]);
+        if (frames_in_flight == 0 || frames_in_flight > HAAR2D_MAX_FRAMES) {
+            printf("Frames in flight must be between 1 and %d\n", HAAR2D_MAX_FRAMES);
+            return 1;
+        }
+        arg = 3;
+    }
+    if (arg == argc) {
+        return run_viewer(frames_in_flight, &default_image, 1U);
+    }
+    return run_viewer(frames_in_flight, argv + arg, argc - arg);
+}
@@ -0,0 +1,29 @@
+// Placement of the coefficients of a block in the subband layout, shared by the single pass kernels.
+// The including shader declares block_dim. Coefficients always fill whole blocks, the engine pads the
+// coefficient images and buffers up to a multiple of block_dim, so every position a block maps to
+// exists even in the partial blocks at the right and bottom edges of a frame.
+
+// Same mapping as deinterleave.comp, from an interleaved offset to its subband offset in the tile.
+ivec2 subband_offset(ivec2 offset, int num_levels) {
+    ivec2 lsb = findLSB(offset);
+    lsb = mix(lsb, ivec2(num_levels), equal(offset, ivec2(0)));
+    const int coeff_level = min(min(lsb.x, lsb.y), num_levels);
+    if (coeff_level == num_levels) {
+        return offset >> num_levels;
+    }
+    ivec2 quarter = (offset >> coeff_level) & 1;
+    return quarter * ivec2(block_dim >> (coeff_level + 1)) + (offset >> (coeff_level + 1));
+}
+
+// Inverse of subband_offset, from an offset in the subband layout of a block to the interleaved
+// offset the lifting steps keep that coefficient at.
+ivec2 interleaved_offset(ivec2 offset, int num_levels) {
+    const int m = max(offset.x, offset.y);
+    if (m < (block_dim >> num_levels)) {
+        return offset << num_levels;
+    }
+    // Detail bands of a level are as large as the highest set bit of the larger coordinate.
+    const int band = 1 << findMSB(m);
+    const int coeff_level = findMSB(block_dim) - findMSB(m) - 1;
+    return ((offset % band) << (coeff_level + 1)) + ((offset / band) << coeff_level);
+}
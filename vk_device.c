@@ -1,10 +1,18 @@
 #include "vk_device.h"
+#include "vk_pipeline.h"
+#include <stdio.h>
 #include <stdlib.h>
-#include <GLFW/glfw3.h>
+#include <string.h>
+#include <stdbool.h>
 
 #define MAX_PHYSICAL_DEVICES 8
 
-VkInstance create_instance() {
+static const char* pipeline_cache_path(void) {
+    const char* path = getenv("HAAR2D_PIPELINE_CACHE");
+    return path ? path : PIPELINE_CACHE_PATH;
+}
+
+VkInstance create_instance(const char** instance_extensions, uint32_t num_instance_extensions) {
     const VkApplicationInfo application_info = {
         .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
         .apiVersion	= VK_MAKE_VERSION(1, 3, 0),
@@ -14,9 +22,6 @@ VkInstance create_instance() {
         .pEngineName = "FFmpeg",
     };
 
-    uint32_t num_instance_extensions = 0;
-    const char** instance_extensions = glfwGetRequiredInstanceExtensions(&num_instance_extensions);
-
     const VkInstanceCreateInfo instance_ci = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
         .pApplicationInfo = &application_info,
@@ -31,38 +36,124 @@ VkInstance create_instance() {
     return instance;
 }
 
-uint32_t get_queue_family(VkPhysicalDevice physical_device) {
+// Picks a family and a queue index in it for every queue type. Compute and transfer prefer families
+// dedicated to them, which run asynchronously to the graphics queue on most hardware.
+void get_queue_families(VkPhysicalDevice physical_device, uint32_t* out_families, uint32_t* out_indices) {
     uint32_t queue_family_count;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, NULL);
     VkQueueFamilyProperties* family_properties = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, family_properties);
 
     uint32_t graphics_queue_family = UINT32_MAX;
+    uint32_t compute_queue_family = UINT32_MAX;
+    uint32_t transfer_queue_family = UINT32_MAX;
     for (uint32_t i = 0; i < queue_family_count; ++i) {
+        const VkQueueFlags flags = family_properties[i].queueFlags;
         // This assumes queue also supports presentation, but that should hold true on any modern hardware.
-        if (family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        if (flags & VK_QUEUE_GRAPHICS_BIT) {
             graphics_queue_family = i;
+        } else if ((flags & VK_QUEUE_COMPUTE_BIT) && compute_queue_family == UINT32_MAX) {
+            compute_queue_family = i;
+        } else if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT) &&
+                   transfer_queue_family == UINT32_MAX) {
+            transfer_queue_family = i;
+        }
+    }
+    if (compute_queue_family == UINT32_MAX) {
+        compute_queue_family = graphics_queue_family;
+    }
+    if (transfer_queue_family == UINT32_MAX) {
+        transfer_queue_family = compute_queue_family;
+    }
+
+    out_families[QUEUE_GRAPHICS] = graphics_queue_family;
+    out_families[QUEUE_COMPUTE] = compute_queue_family;
+    out_families[QUEUE_TRANSFER] = transfer_queue_family;
+
+    // Queue types sharing a family still get a queue of their own as long as the family has enough.
+    for (uint32_t type = 0; type < NUM_QUEUE_TYPES; ++type) {
+        uint32_t index = 0;
+        for (uint32_t other = 0; other < type; ++other) {
+            index += out_families[other] == out_families[type] ? 1U : 0U;
         }
+        const uint32_t queue_count = family_properties[out_families[type]].queueCount;
+        out_indices[type] = index < queue_count ? index : queue_count - 1;
     }
 
     free(family_properties);
-    return graphics_queue_family;
 }
 
-VkDevice create_device(VkPhysicalDevice physical_device, uint32_t graphics_queue_family) {
-    const float priorities[] = { 1.0f };
-    const VkDeviceQueueCreateInfo queue_create_info = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+static bool has_device_extension(VkPhysicalDevice physical_device, const char* name) {
+    uint32_t num_extensions = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &num_extensions, NULL);
+    VkExtensionProperties* extensions = (VkExtensionProperties*)malloc(num_extensions * sizeof(VkExtensionProperties));
+    vkEnumerateDeviceExtensionProperties(physical_device, NULL, &num_extensions, extensions);
+
+    bool found = false;
+    for (uint32_t i = 0; i < num_extensions && !found; ++i) {
+        found = strcmp(extensions[i].extensionName, name) == 0;
+    }
+    free(extensions);
+    return found;
+}
+
+VkDevice create_device(VkPhysicalDevice physical_device, const uint32_t* queue_families, const uint32_t* queue_indices,
+                       bool headless, bool shader_float16, bool shader_int16, bool external_memory_host,
+                       bool subgroup_size_control, bool subgroup_size_control_extension) {
+    // Create every family once, with enough queues for the highest index used in it.
+    const float priorities[NUM_QUEUE_TYPES] = { 1.0f, 1.0f, 1.0f };
+    VkDeviceQueueCreateInfo queue_create_infos[NUM_QUEUE_TYPES];
+    uint32_t num_queue_create_infos = 0;
+    for (uint32_t type = 0; type < NUM_QUEUE_TYPES; ++type) {
+        uint32_t i = 0;
+        while (i < num_queue_create_infos && queue_create_infos[i].queueFamilyIndex != queue_families[type]) {
+            ++i;
+        }
+        if (i == num_queue_create_infos) {
+            queue_create_infos[num_queue_create_infos++] = (VkDeviceQueueCreateInfo){
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .pNext = NULL,
+                .queueCount = 0,
+                .queueFamilyIndex = queue_families[type],
+                .pQueuePriorities = priorities,
+            };
+        }
+        if (queue_create_infos[i].queueCount < queue_indices[type] + 1) {
+            queue_create_infos[i].queueCount = queue_indices[type] + 1;
+        }
+    }
+
+    const char* device_extensions[3];
+    uint32_t num_device_extensions = 0;
+    if (!headless) {
+        device_extensions[num_device_extensions++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    }
+    if (external_memory_host) {
+        device_extensions[num_device_extensions++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+    }
+    if (subgroup_size_control && subgroup_size_control_extension) {
+        device_extensions[num_device_extensions++] = VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME;
+    }
+
+    const VkPhysicalDeviceSubgroupSizeControlFeatures size_control_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES,
         .pNext = NULL,
-        .queueCount = 1,
-        .queueFamilyIndex = graphics_queue_family,
-        .pQueuePriorities = priorities,
+        .subgroupSizeControl = VK_TRUE,
+        .computeFullSubgroups = VK_TRUE,
+    };
+
+    // Query pools are reset from the host since transfer queues can't reset them.
+    const VkPhysicalDeviceVulkan12Features vulkan12_features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .pNext = subgroup_size_control ? &size_control_features : NULL,
+        .hostQueryReset = VK_TRUE,
+        .timelineSemaphore = VK_TRUE,
+        .shaderFloat16 = shader_float16 ? VK_TRUE : VK_FALSE,
     };
 
-    const char* device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     const VkPhysicalDeviceImageRobustnessFeatures robustness_features = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_ROBUSTNESS_FEATURES,
-        .pNext = NULL,
+        .pNext = &vulkan12_features,
         .robustImageAccess = VK_TRUE,
     };
 
@@ -71,27 +162,37 @@ VkDevice create_device(VkPhysicalDevice physical_device, uint32_t graphics_queue
         .pNext = &robustness_features,
         .features = {
             .robustBufferAccess = VK_TRUE,
+            // The transform shaders leave the image format open to run on RGBA frames and planes alike.
+            .shaderStorageImageReadWithoutFormat = VK_TRUE,
+            .shaderStorageImageWriteWithoutFormat = VK_TRUE,
+            .shaderInt16 = shader_int16 ? VK_TRUE : VK_FALSE,
         },
     };
 
     const VkDeviceCreateInfo device_create_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &features2,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queue_create_info,
-        .enabledExtensionCount = 1,
-        .ppEnabledExtensionNames = device_extensions,
+        .queueCreateInfoCount = num_queue_create_infos,
+        .pQueueCreateInfos = queue_create_infos,
+        .enabledExtensionCount = num_device_extensions,
+        .ppEnabledExtensionNames = num_device_extensions > 0 ? device_extensions : NULL,
     };
 
     VkDevice device	= VK_NULL_HANDLE;
-    vkCreateDevice(physical_device, &device_create_info, NULL, &device);
+    const VkResult result = vkCreateDevice(physical_device, &device_create_info, NULL, &device);
+    if (result != VK_SUCCESS) {
+        printf("Unable to create device with result %d\n", result);
+        return VK_NULL_HANDLE;
+    }
     volkLoadDevice(device);
 
     return device;
 }
 
-void create_context(struct VkContext* out_context) {
-    const VkInstance instance = create_instance();
+bool create_context(struct VkContext* out_context, const char** instance_extensions, uint32_t num_instance_extensions) {
+    // Headless contexts never create a surface, so they don't need the swapchain extension either.
+    const bool headless = num_instance_extensions == 0;
+    const VkInstance instance = create_instance(instance_extensions, num_instance_extensions);
 
     uint32_t num_physical_devices = 0;
     vkEnumeratePhysicalDevices(instance, &num_physical_devices, NULL);
@@ -99,20 +200,199 @@ void create_context(struct VkContext* out_context) {
     vkEnumeratePhysicalDevices(instance, &num_physical_devices, physical_devices);
 
     const uint32_t index = 0;
-    const uint32_t queue_family_index = get_queue_family(physical_devices[index]);
-    const VkDevice device = create_device(physical_devices[index], queue_family_index);
+    uint32_t queue_families[NUM_QUEUE_TYPES];
+    uint32_t queue_indices[NUM_QUEUE_TYPES];
+    get_queue_families(physical_devices[index], queue_families, queue_indices);
 
-    VkQueue queue;
-    vkGetDeviceQueue(device, queue_family_index, 0, &queue);
+    // Subgroup size control is core in Vulkan 1.3 and an extension before that.
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_devices[index], &device_properties);
+    const bool size_control_extension = device_properties.apiVersion < VK_API_VERSION_1_3 &&
+                                        has_device_extension(physical_devices[index],
+                                                             VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME);
+    const bool size_control_available = device_properties.apiVersion >= VK_API_VERSION_1_3 || size_control_extension;
+
+    // 16-bit types let the transform keep its coefficients in half the shared memory.
+    VkPhysicalDeviceSubgroupSizeControlFeatures supported_size_control = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES,
+        .pNext = NULL,
+    };
+    VkPhysicalDeviceVulkan12Features supported_vulkan12 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .pNext = size_control_available ? &supported_size_control : NULL,
+    };
+    VkPhysicalDeviceFeatures2 supported = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &supported_vulkan12,
+    };
+    vkGetPhysicalDeviceFeatures2(physical_devices[index], &supported);
+    out_context->shader_float16 = supported_vulkan12.shaderFloat16 == VK_TRUE;
+    out_context->shader_int16 = supported.features.shaderInt16 == VK_TRUE;
+
+    // The transform shaders leave the image format open, so they can't run without these.
+    if (!supported.features.shaderStorageImageReadWithoutFormat ||
+        !supported.features.shaderStorageImageWriteWithoutFormat) {
+        printf("Unable to access storage images without a format on this device\n");
+        vkDestroyInstance(instance, NULL);
+        return false;
+    }
+
+    // Host memory imports let frames decoded on the CPU be read by the GPU without a copy to staging.
+    out_context->external_memory_host = has_device_extension(physical_devices[index],
+                                                             VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+        .pNext = NULL,
+        .minImportedHostPointerAlignment = 0,
+    };
+    VkPhysicalDeviceSubgroupSizeControlProperties size_control_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES,
+        .pNext = out_context->external_memory_host ? &host_properties : NULL,
+    };
+    VkPhysicalDeviceSubgroupProperties subgroup_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+        .pNext = size_control_available ? &size_control_properties : size_control_properties.pNext,
+    };
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &subgroup_properties,
+    };
+    vkGetPhysicalDeviceProperties2(physical_devices[index], &properties);
+    out_context->subgroup_size = subgroup_properties.subgroupSize;
+    out_context->subgroup_shuffle = (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+                                    (subgroup_properties.supportedOperations & VK_SUBGROUP_FEATURE_SHUFFLE_BIT);
+    out_context->host_import_alignment = host_properties.minImportedHostPointerAlignment;
+    out_context->subgroup_size_control = size_control_available &&
+                                         supported_size_control.subgroupSizeControl == VK_TRUE &&
+                                         supported_size_control.computeFullSubgroups == VK_TRUE &&
+                                         (size_control_properties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT);
+    out_context->max_workgroup_subgroups = out_context->subgroup_size_control
+                                               ? size_control_properties.maxComputeWorkgroupSubgroups
+                                               : 0U;
+
+    const VkDevice device = create_device(physical_devices[index], queue_families, queue_indices, headless,
+                                          out_context->shader_float16, out_context->shader_int16,
+                                          out_context->external_memory_host, out_context->subgroup_size_control,
+                                          size_control_extension);
+    if (device == VK_NULL_HANDLE) {
+        vkDestroyInstance(instance, NULL);
+        return false;
+    }
 
     out_context->instance = instance;
     out_context->physical_device = physical_devices[index];
-    out_context->queue_family = queue_family_index;
     out_context->device = device;
-    out_context->queue = queue;
+
+    const VkSemaphoreTypeCreateInfo semaphore_type_ci = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .pNext = NULL,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0U,
+    };
+    const VkSemaphoreCreateInfo semaphore_ci = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphore_type_ci,
+        .flags = 0,
+    };
+    for (uint32_t type = 0; type < NUM_QUEUE_TYPES; ++type) {
+        struct VkQueueTimeline* queue = &out_context->queues[type];
+        queue->family = queue_families[type];
+        vkGetDeviceQueue(device, queue_families[type], queue_indices[type], &queue->queue);
+        vkCreateSemaphore(device, &semaphore_ci, NULL, &queue->timeline);
+        queue->last_submitted = 0;
+    }
+    out_context->queue_family = out_context->queues[QUEUE_GRAPHICS].family;
+    out_context->queue = out_context->queues[QUEUE_GRAPHICS].queue;
+
+    create_allocator(out_context->physical_device, device, &out_context->allocator);
+    create_staging_ring(out_context, &out_context->staging, STAGING_RING_SIZE);
+    out_context->pipeline_cache = load_pipeline_cache(out_context, pipeline_cache_path());
+    return true;
+}
+
+uint64_t submit_commands(struct VkContext* context, enum VkQueueType type,
+                         const VkCommandBuffer* cmdbufs, uint32_t num_cmdbufs, uint64_t wait_point,
+                         VkSemaphore wait_semaphore, VkPipelineStageFlags wait_stage, VkSemaphore signal_semaphore) {
+    struct VkQueueTimeline* queue = &context->queues[type];
+    const uint64_t value = queue->last_submitted + 1;
+
+    // Timelines always come first, values of binary semaphores are ignored.
+    VkSemaphore wait_semaphores[2];
+    uint64_t wait_values[2];
+    const VkPipelineStageFlags wait_stages[2] = {wait_stage, wait_stage};
+    uint32_t num_waits = 0;
+    if (TIMELINE_POINT_VALUE(wait_point) != 0) {
+        wait_semaphores[num_waits] = context->queues[TIMELINE_POINT_QUEUE(wait_point)].timeline;
+        wait_values[num_waits++] = TIMELINE_POINT_VALUE(wait_point);
+    }
+    if (wait_semaphore) {
+        wait_semaphores[num_waits] = wait_semaphore;
+        wait_values[num_waits++] = 0U;
+    }
+
+    const VkSemaphore signal_semaphores[2] = {queue->timeline, signal_semaphore};
+    const uint64_t signal_values[2] = {value, 0U};
+    const VkTimelineSemaphoreSubmitInfo timeline_info = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreValueCount = num_waits,
+        .pWaitSemaphoreValues = wait_values,
+        .signalSemaphoreValueCount = signal_semaphore ? 2U : 1U,
+        .pSignalSemaphoreValues = signal_values,
+    };
+    const VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = num_waits,
+        .pWaitSemaphores = wait_semaphores,
+        .pWaitDstStageMask = wait_stages,
+        .commandBufferCount = num_cmdbufs,
+        .pCommandBuffers = cmdbufs,
+        .signalSemaphoreCount = signal_semaphore ? 2U : 1U,
+        .pSignalSemaphores = signal_semaphores,
+    };
+
+    const VkResult result = vkQueueSubmit(queue->queue, 1U, &submit_info, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) {
+        printf("Unable to submit command buffers with result %d\n", result);
+    }
+    queue->last_submitted = value;
+    return TIMELINE_POINT(type, value);
+}
+
+bool timeline_reached(const struct VkContext* context, uint64_t point) {
+    const uint64_t wanted = TIMELINE_POINT_VALUE(point);
+    if (wanted == 0) {
+        return true;
+    }
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(context->device, context->queues[TIMELINE_POINT_QUEUE(point)].timeline, &value);
+    return value >= wanted;
+}
+
+void timeline_wait(const struct VkContext* context, uint64_t point) {
+    const uint64_t value = TIMELINE_POINT_VALUE(point);
+    const VkSemaphoreWaitInfo wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .semaphoreCount = 1U,
+        .pSemaphores = &context->queues[TIMELINE_POINT_QUEUE(point)].timeline,
+        .pValues = &value,
+    };
+    vkWaitSemaphores(context->device, &wait_info, UINT64_MAX);
 }
 
 void destroy_context(struct VkContext* context) {
+    // Pending frames may still use the staging ring.
+    vkDeviceWaitIdle(context->device);
+    destroy_staging_ring(&context->staging);
+    save_pipeline_cache(context, context->pipeline_cache, pipeline_cache_path());
+    vkDestroyPipelineCache(context->device, context->pipeline_cache, NULL);
+    for (uint32_t type = 0; type < NUM_QUEUE_TYPES; ++type) {
+        vkDestroySemaphore(context->device, context->queues[type].timeline, NULL);
+    }
+    destroy_allocator(&context->allocator);
     vkDestroyDevice(context->device, NULL);
     vkDestroyInstance(context->instance, NULL);
 }
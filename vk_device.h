@@ -1,15 +1,84 @@
 #pragma once
 
 #include <volk.h>
+#include <stdbool.h>
+#include "vk_memory.h"
+#include "vk_staging.h"
+
+enum VkQueueType {
+    QUEUE_GRAPHICS,
+    // Falls back to the graphics family when there is no compute-only family.
+    QUEUE_COMPUTE,
+    // Falls back to the compute family when there is no transfer-only family.
+    QUEUE_TRANSFER,
+    NUM_QUEUE_TYPES,
+};
+
+// A queue along with the timeline semaphore signaled by every submission to it, with a
+// monotonically increasing value.
+struct VkQueueTimeline {
+    VkQueue queue;
+    uint32_t family;
+    VkSemaphore timeline;
+    uint64_t last_submitted;
+};
+
+// Timeline points identify a submission on any of the queues, the queue type is kept in the
+// upper bits of the value. Point 0 is always reached.
+#define TIMELINE_QUEUE_SHIFT 56
+#define TIMELINE_POINT(type, value) (((uint64_t)(type) << TIMELINE_QUEUE_SHIFT) | (value))
+#define TIMELINE_POINT_QUEUE(point) ((enum VkQueueType)((point) >> TIMELINE_QUEUE_SHIFT))
+#define TIMELINE_POINT_VALUE(point) ((point) & ((1ULL << TIMELINE_QUEUE_SHIFT) - 1))
 
 struct VkContext {
     VkInstance instance;
     VkPhysicalDevice physical_device;
     VkDevice device;
+    // Graphics queue, also used for presentation.
     uint32_t queue_family;
     VkQueue queue;
+    struct VkQueueTimeline queues[NUM_QUEUE_TYPES];
+    // Backs every image and buffer created on this context.
+    struct VkAllocator allocator;
+    // Shared by every upload and readback made on this context.
+    struct VkStagingRing staging;
+    // Shared by all pipelines, persisted across runs at PIPELINE_CACHE_PATH.
+    VkPipelineCache pipeline_cache;
+    // Optional shader arithmetic types, enabled whenever the device supports them.
+    bool shader_float16;
+    bool shader_int16;
+    // Lanes per subgroup, and whether compute shaders can shuffle values between them.
+    uint32_t subgroup_size;
+    bool subgroup_shuffle;
+    // Whether compute pipelines can require full subgroups of subgroup_size, and how many of those
+    // fit in a workgroup then.
+    bool subgroup_size_control;
+    uint32_t max_workgroup_subgroups;
+    // Whether host allocations can be imported as device memory, and the alignment their address
+    // and size need for it.
+    bool external_memory_host;
+    VkDeviceSize host_import_alignment;
 };
 
-void create_context(struct VkContext* out_context);
+// Location of the on-disk pipeline cache, can be overridden with the HAAR2D_PIPELINE_CACHE
+// environment variable.
+#define PIPELINE_CACHE_PATH "haar2d_pipeline_cache.bin"
+
+// Passing no instance extensions creates a headless context that can't present to a surface.
+// Returns false when the device lacks features the transforms need or can't be created.
+bool create_context(struct VkContext* out_context, const char** instance_extensions, uint32_t num_instance_extensions);
+
+// Submits the command buffers to a queue and returns the timeline point that is reached once they
+// complete. The submission can wait at wait_stage for a point of another submission, on any queue.
+// The binary semaphores are optional and only needed to synchronize with the swapchain.
+uint64_t submit_commands(struct VkContext* context, enum VkQueueType type,
+                         const VkCommandBuffer* cmdbufs, uint32_t num_cmdbufs, uint64_t wait_point,
+                         VkSemaphore wait_semaphore, VkPipelineStageFlags wait_stage, VkSemaphore signal_semaphore);
+
+// Returns whether the submission of a timeline point has completed.
+bool timeline_reached(const struct VkContext* context, uint64_t point);
+
+// Blocks until the submission of a timeline point has completed.
+void timeline_wait(const struct VkContext* context, uint64_t point);
 
 void destroy_context(struct VkContext* context);
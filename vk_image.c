@@ -3,17 +3,6 @@
 #include "vk_image.h"
 #include "vk_device.h"
 
-static uint32_t find_memory_type(const VkPhysicalDeviceMemoryProperties* properties, VkMemoryPropertyFlags wanted) {
-    for (uint32_t i = 0; i < properties->memoryTypeCount; ++i) {
-        const VkMemoryPropertyFlags flags = properties->memoryTypes[i].propertyFlags;
-        if ((flags & wanted) == wanted) {
-            return i;
-        }
-    }
-    printf("Unable to find suitable memory type!\n");
-    return UINT32_MAX;
-}
-
 void create_texture(struct VkContext* context, struct VkTexture* out_texture,
                     uint32_t width, uint32_t height, VkFormat format, VkFormat view_format) {
     out_texture->width = width;
@@ -49,24 +38,16 @@ void create_texture(struct VkContext* context, struct VkTexture* out_texture,
     VkMemoryRequirements requirements;
     vkGetImageMemoryRequirements(context->device, out_texture->image, &requirements);
 
-    // Query memory heaps this physical device offsers. We want to find a device local one.
-    VkPhysicalDeviceMemoryProperties properties;
-    vkGetPhysicalDeviceMemoryProperties(context->physical_device, &properties);
-
-    VkMemoryAllocateInfo allocate_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = requirements.size,
-        .memoryTypeIndex = find_memory_type(&properties, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
-    };
-
-    result = vkAllocateMemory(context->device, &allocate_info, NULL, &out_texture->image_memory);
-    if (result != VK_SUCCESS) {
-        printf("Unable to allocate image memory with result %d\n", result);
+    // Carve it out of a device local block of the context's allocator.
+    if (!allocate_memory(&context->allocator, &requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         &out_texture->image_memory)) {
+        printf("Unable to allocate image memory\n");
         return;
     }
 
     // Back our image handle with the allocated memory
-    vkBindImageMemory(context->device, out_texture->image, out_texture->image_memory, 0);
+    vkBindImageMemory(context->device, out_texture->image, out_texture->image_memory.memory,
+                      out_texture->image_memory.offset);
 
     // Create image view
     const VkImageViewCreateInfo image_view_ci = {
@@ -125,44 +106,31 @@ void create_texture(struct VkContext* context, struct VkTexture* out_texture,
 
     desc_layout_ci.bindingCount = 2U;
     vkCreateDescriptorSetLayout(context->device, &desc_layout_ci, NULL, &out_texture->desc_layout_2);
+}
 
-    // Also do the same for the staging buffer. In real applications this should be a global buffer
-    const uint32_t buffer_size = 16 * 1024 * 1024;
-    const VkBufferCreateInfo buffer_ci = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .size = buffer_size,
-        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 0U,
-        .pQueueFamilyIndices = NULL,
-    };
-    result = vkCreateBuffer(context->device, &buffer_ci, NULL, &out_texture->staging_buffer);
-    if (result != VK_SUCCESS) {
-        printf("Unable to create buffer with result %d\n", result);
-        return;
-    }
-
-    // Determine how much memory we need to allocate for our staging buffer.
-    vkGetBufferMemoryRequirements(context->device, out_texture->staging_buffer, &requirements);
-
-    // For the buffer we have specific property requirements so pass them here
-    allocate_info.allocationSize = requirements.size;
-    allocate_info.memoryTypeIndex = find_memory_type(&properties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    result = vkAllocateMemory(context->device, &allocate_info, NULL, &out_texture->staging_memory);
-    if (result != VK_SUCCESS) {
-        printf("Unable to allocate staging memory with result %d\n", result);
-        return;
+VkDeviceSize texture_size(const struct VkTexture* texture) {
+    uint32_t texel_size;
+    switch (texture->format) {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_UINT:
+        texel_size = 1U;
+        break;
+    case VK_FORMAT_R16_UNORM:
+    case VK_FORMAT_R16_UINT:
+    case VK_FORMAT_R16_SINT:
+    case VK_FORMAT_R16_SFLOAT:
+        texel_size = 2U;
+        break;
+    case VK_FORMAT_R16G16B16A16_SINT:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        texel_size = 8U;
+        break;
+    default:
+        // The 8-bit RGBA formats and R32_SINT.
+        texel_size = 4U;
+        break;
     }
-
-    // Back our buffer handle with the allocated memory
-    vkBindBufferMemory(context->device, out_texture->staging_buffer, out_texture->staging_memory, 0);
-
-    // Map the buffer now.
-    vkMapMemory(context->device, out_texture->staging_memory, 0U, VK_WHOLE_SIZE, 0U, &out_texture->staging);
+    return (VkDeviceSize)texture->width * texture->height * texel_size;
 }
 
 void transition_layout(VkCommandBuffer cmdbuf, struct VkTexture* texture, VkImageLayout new_layout,
@@ -192,6 +160,48 @@ void transition_layout(VkCommandBuffer cmdbuf, struct VkTexture* texture, VkImag
     texture->layout = new_layout;
 }
 
+// Both halves of an ownership transfer must describe the same barrier apart from the access masks
+// and stages, which only apply to the queue the half is recorded on.
+static void ownership_barrier(VkCommandBuffer cmdbuf, const struct VkTexture* texture, uint32_t src_family,
+                              uint32_t dst_family, VkAccessFlags src_access, VkAccessFlags dst_access,
+                              VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) {
+    if (src_family == dst_family) {
+        return;
+    }
+
+    const VkImageMemoryBarrier image_barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+        .oldLayout = texture->layout,
+        .newLayout = texture->layout,
+        .srcQueueFamilyIndex = src_family,
+        .dstQueueFamilyIndex = dst_family,
+        .image = texture->image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .baseArrayLayer = 0,
+            .layerCount = VK_REMAINING_ARRAY_LAYERS,
+        },
+    };
+
+    vkCmdPipelineBarrier(cmdbuf, src_stage, dst_stage, 0, 0U, NULL, 0U, NULL, 1U, &image_barrier);
+}
+
+void release_ownership(VkCommandBuffer cmdbuf, const struct VkTexture* texture, uint32_t src_family,
+                       uint32_t dst_family, VkAccessFlags src_access, VkPipelineStageFlags src_stage) {
+    ownership_barrier(cmdbuf, texture, src_family, dst_family, src_access, VK_ACCESS_NONE,
+                      src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+}
+
+void acquire_ownership(VkCommandBuffer cmdbuf, const struct VkTexture* texture, uint32_t src_family,
+                       uint32_t dst_family, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage) {
+    ownership_barrier(cmdbuf, texture, src_family, dst_family, VK_ACCESS_NONE, dst_access,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage);
+}
+
 void write_as_storage_descriptor(VkDescriptorSet set, const struct VkTexture** textures, uint32_t num_textures) {
     VkDescriptorImageInfo image_infos[8];
     VkWriteDescriptorSet write_sets[8];
@@ -215,10 +225,42 @@ void write_as_storage_descriptor(VkDescriptorSet set, const struct VkTexture** t
     vkUpdateDescriptorSets(textures[0]->context->device, num_textures, write_sets, 0U, NULL);
 }
 
-void upload_image_data(VkCommandBuffer cmdbuf, uint8_t* data, uint32_t size, const struct VkTexture* texture) {
-    memcpy(texture->staging, data, size);
+bool upload_image_data(VkCommandBuffer cmdbuf, const uint8_t* data, uint32_t size, const struct VkTexture* texture) {
+    struct VkStagingSlice slice;
+    if (!staging_alloc(&texture->context->staging, size, &slice)) {
+        return false;
+    }
+
+    memcpy(slice.data, data, size);
+    upload_image_slice(cmdbuf, &slice, texture);
+    return true;
+}
+
+void upload_image_slice(VkCommandBuffer cmdbuf, const struct VkStagingSlice* slice, const struct VkTexture* texture) {
+    const VkBufferImageCopy image_copy = {
+        .bufferOffset = slice->offset,
+        .bufferRowLength = texture->width,
+        .bufferImageHeight = texture->height,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0U,
+            .baseArrayLayer = 0U,
+            .layerCount = 1U,
+        },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {texture->width, texture->height, 1U},
+    };
+
+    vkCmdCopyBufferToImage(cmdbuf, slice->buffer, texture->image, VK_IMAGE_LAYOUT_GENERAL, 1U, &image_copy);
+}
+
+bool download_image_data(VkCommandBuffer cmdbuf, const struct VkTexture* texture, struct VkStagingSlice* out_slice) {
+    if (!staging_alloc(&texture->context->staging, texture_size(texture), out_slice)) {
+        return false;
+    }
+
     const VkBufferImageCopy image_copy = {
-        .bufferOffset = 0U,
+        .bufferOffset = out_slice->offset,
         .bufferRowLength = texture->width,
         .bufferImageHeight = texture->height,
         .imageSubresource = {
@@ -231,17 +273,15 @@ void upload_image_data(VkCommandBuffer cmdbuf, uint8_t* data, uint32_t size, con
         .imageExtent = {texture->width, texture->height, 1U},
     };
 
-    vkCmdCopyBufferToImage(cmdbuf, texture->staging_buffer, texture->image, VK_IMAGE_LAYOUT_GENERAL, 1U, &image_copy);
+    vkCmdCopyImageToBuffer(cmdbuf, texture->image, VK_IMAGE_LAYOUT_GENERAL, out_slice->buffer, 1U, &image_copy);
+    return true;
 }
 
 void destroy_texture(const struct VkTexture* texture) {
     const VkDevice device = texture->context->device;
-    vkUnmapMemory(device, texture->staging_memory);
     vkDestroyDescriptorSetLayout(device, texture->desc_layout, NULL);
     vkDestroyDescriptorSetLayout(device, texture->desc_layout_2, NULL);
-    vkDestroyBuffer(device, texture->staging_buffer, NULL);
     vkDestroyImageView(device, texture->image_view, NULL);
-    vkFreeMemory(device, texture->staging_memory, NULL);
-    vkFreeMemory(device, texture->image_memory, NULL);
     vkDestroyImage(device, texture->image, NULL);
+    free_memory(&texture->context->allocator, &texture->image_memory);
 }
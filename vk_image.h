@@ -1,6 +1,9 @@
 #pragma once
 
 #include <volk.h>
+#include <stdbool.h>
+#include "vk_memory.h"
+#include "vk_staging.h"
 
 struct VkContext;
 
@@ -14,21 +17,38 @@ struct VkTexture {
     VkImage image;
     VkImageView image_view;
     VkImageLayout layout;
-    VkDeviceMemory image_memory;
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_memory;
-    void* staging;
+    struct VkAllocation image_memory;
 };
 
 void create_texture(struct VkContext* context, struct VkTexture* out_texture,
                     uint32_t width, uint32_t height, VkFormat format, VkFormat view_format);
 
+// Size in bytes of the texture's pixels when packed tightly, as in staging memory.
+VkDeviceSize texture_size(const struct VkTexture* texture);
+
 void transition_layout(VkCommandBuffer cmdbuf, struct VkTexture* texture, VkImageLayout new_layout,
                        VkAccessFlagBits src_access, VkAccessFlagBits dst_access,
                        VkPipelineStageFlagBits src_stage, VkPipelineStageFlagBits dst_stage);
 
+// Hand the texture over from a queue of src_family to one of dst_family, keeping its contents and
+// layout. The release is recorded on the source queue and the acquire on the destination queue,
+// which must wait for the release with a semaphore. Nothing is recorded if both families match.
+void release_ownership(VkCommandBuffer cmdbuf, const struct VkTexture* texture, uint32_t src_family,
+                       uint32_t dst_family, VkAccessFlags src_access, VkPipelineStageFlags src_stage);
+
+void acquire_ownership(VkCommandBuffer cmdbuf, const struct VkTexture* texture, uint32_t src_family,
+                       uint32_t dst_family, VkAccessFlags dst_access, VkPipelineStageFlags dst_stage);
+
 void write_as_storage_descriptor(VkDescriptorSet set, const struct VkTexture** textures, uint32_t num_textures);
 
-void upload_image_data(VkCommandBuffer cmdbuf, uint8_t* data, uint32_t size, const struct VkTexture* texture);
+// Copies data into a slice of the context's staging ring and records its upload to the texture.
+bool upload_image_data(VkCommandBuffer cmdbuf, const uint8_t* data, uint32_t size, const struct VkTexture* texture);
+
+// Records the upload of a staging slice the caller already filled with the pixels of the texture.
+void upload_image_slice(VkCommandBuffer cmdbuf, const struct VkStagingSlice* slice, const struct VkTexture* texture);
+
+// Records a copy of the texture into a slice of the context's staging ring. The pixels can be read
+// from out_slice->data once the command buffer has completed.
+bool download_image_data(VkCommandBuffer cmdbuf, const struct VkTexture* texture, struct VkStagingSlice* out_slice);
 
 void destroy_texture(const struct VkTexture* texture);
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vk_memory.h"
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void create_allocator(VkPhysicalDevice physical_device, VkDevice device, struct VkAllocator* out_allocator) {
+    out_allocator->device = device;
+    out_allocator->blocks = NULL;
+    out_allocator->num_blocks = 0;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &out_allocator->properties);
+
+    // Buffers and optimal images end up in the same blocks, so keep every range on its own
+    // granularity page instead of tracking neighbouring resource types.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    out_allocator->granularity = properties.limits.bufferImageGranularity;
+}
+
+uint32_t allocator_find_type(const struct VkAllocator* allocator, uint32_t type_bits, VkMemoryPropertyFlags wanted) {
+    for (uint32_t i = 0; i < allocator->properties.memoryTypeCount; ++i) {
+        const VkMemoryPropertyFlags flags = allocator->properties.memoryTypes[i].propertyFlags;
+        if ((type_bits & (1U << i)) && (flags & wanted) == wanted) {
+            return i;
+        }
+    }
+    printf("Unable to find suitable memory type!\n");
+    return UINT32_MAX;
+}
+
+static void insert_range(struct VkMemoryBlock* block, uint32_t index, VkDeviceSize offset, VkDeviceSize size) {
+    if (block->num_free_ranges == block->free_capacity) {
+        block->free_capacity = block->free_capacity ? block->free_capacity * 2 : 16;
+        block->free_ranges = (struct VkMemoryRange*)realloc(block->free_ranges,
+                                                            block->free_capacity * sizeof(struct VkMemoryRange));
+    }
+    memmove(&block->free_ranges[index + 1], &block->free_ranges[index],
+            (block->num_free_ranges - index) * sizeof(struct VkMemoryRange));
+    block->free_ranges[index].offset = offset;
+    block->free_ranges[index].size = size;
+    block->num_free_ranges++;
+}
+
+static void remove_range(struct VkMemoryBlock* block, uint32_t index) {
+    memmove(&block->free_ranges[index], &block->free_ranges[index + 1],
+            (block->num_free_ranges - index - 1) * sizeof(struct VkMemoryRange));
+    block->num_free_ranges--;
+}
+
+// First fit in the free list, splitting off the alignment padding and the tail.
+static bool block_alloc(struct VkMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* out_offset) {
+    for (uint32_t i = 0; i < block->num_free_ranges; i++) {
+        const struct VkMemoryRange range = block->free_ranges[i];
+        const VkDeviceSize offset = align_up(range.offset, alignment);
+        if (offset + size > range.offset + range.size) {
+            continue;
+        }
+
+        remove_range(block, i);
+        const VkDeviceSize end = offset + size;
+        if (end < range.offset + range.size) {
+            insert_range(block, i, end, range.offset + range.size - end);
+        }
+        if (offset > range.offset) {
+            insert_range(block, i, range.offset, offset - range.offset);
+        }
+        *out_offset = offset;
+        return true;
+    }
+    return false;
+}
+
+static bool create_block(struct VkAllocator* allocator, uint32_t type_index, VkDeviceSize size) {
+    const VkMemoryAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = type_index,
+    };
+    VkDeviceMemory memory;
+    VkResult result = vkAllocateMemory(allocator->device, &allocate_info, NULL, &memory);
+    if (result != VK_SUCCESS) {
+        printf("Unable to allocate memory block with result %d\n", result);
+        return false;
+    }
+
+    allocator->blocks = (struct VkMemoryBlock*)realloc(allocator->blocks,
+                                                       (allocator->num_blocks + 1) * sizeof(struct VkMemoryBlock));
+    struct VkMemoryBlock* block = &allocator->blocks[allocator->num_blocks++];
+    block->memory = memory;
+    block->type_index = type_index;
+    block->size = size;
+    block->mapped = NULL;
+    block->free_ranges = NULL;
+    block->num_free_ranges = 0;
+    block->free_capacity = 0;
+    insert_range(block, 0, 0, size);
+
+    if (allocator->properties.memoryTypes[type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vkMapMemory(allocator->device, memory, 0U, VK_WHOLE_SIZE, 0U, (void**)&block->mapped);
+    }
+    return true;
+}
+
+bool allocate_memory(struct VkAllocator* allocator, const VkMemoryRequirements* requirements,
+                     VkMemoryPropertyFlags wanted, struct VkAllocation* out_allocation) {
+    const uint32_t type_index = allocator_find_type(allocator, requirements->memoryTypeBits, wanted);
+    if (type_index == UINT32_MAX) {
+        return false;
+    }
+
+    VkDeviceSize alignment = requirements->alignment;
+    if (alignment < allocator->granularity) {
+        alignment = allocator->granularity;
+    }
+    const VkDeviceSize size = align_up(requirements->size, allocator->granularity);
+
+    // Look through the existing blocks of this type first and only grow if none has room.
+    uint32_t block_index = 0;
+    VkDeviceSize offset = 0;
+    for (; block_index < allocator->num_blocks; block_index++) {
+        struct VkMemoryBlock* block = &allocator->blocks[block_index];
+        if (block->type_index == type_index && block_alloc(block, size, alignment, &offset)) {
+            break;
+        }
+    }
+    if (block_index == allocator->num_blocks) {
+        if (!create_block(allocator, type_index, size > MEMORY_BLOCK_SIZE ? size : MEMORY_BLOCK_SIZE)) {
+            return false;
+        }
+        block_alloc(&allocator->blocks[block_index], size, alignment, &offset);
+    }
+
+    const struct VkMemoryBlock* block = &allocator->blocks[block_index];
+    out_allocation->memory = block->memory;
+    out_allocation->offset = offset;
+    out_allocation->size = size;
+    out_allocation->block = block_index;
+    out_allocation->mapped = block->mapped ? block->mapped + offset : NULL;
+    return true;
+}
+
+void free_memory(struct VkAllocator* allocator, const struct VkAllocation* allocation) {
+    struct VkMemoryBlock* block = &allocator->blocks[allocation->block];
+
+    uint32_t index = 0;
+    while (index < block->num_free_ranges && block->free_ranges[index].offset < allocation->offset) {
+        index++;
+    }
+    insert_range(block, index, allocation->offset, allocation->size);
+
+    // Merge with the free neighbours so large ranges can be handed out again.
+    if (index + 1 < block->num_free_ranges) {
+        struct VkMemoryRange* range = &block->free_ranges[index];
+        const struct VkMemoryRange* next = &block->free_ranges[index + 1];
+        if (range->offset + range->size == next->offset) {
+            range->size += next->size;
+            remove_range(block, index + 1);
+        }
+    }
+    if (index > 0) {
+        struct VkMemoryRange* prev = &block->free_ranges[index - 1];
+        const struct VkMemoryRange* range = &block->free_ranges[index];
+        if (prev->offset + prev->size == range->offset) {
+            prev->size += range->size;
+            remove_range(block, index);
+        }
+    }
+}
+
+void destroy_allocator(const struct VkAllocator* allocator) {
+    for (uint32_t i = 0; i < allocator->num_blocks; i++) {
+        const struct VkMemoryBlock* block = &allocator->blocks[i];
+        if (block->mapped) {
+            vkUnmapMemory(allocator->device, block->memory);
+        }
+        vkFreeMemory(allocator->device, block->memory, NULL);
+        free(block->free_ranges);
+    }
+    free(allocator->blocks);
+}
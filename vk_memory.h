@@ -0,0 +1,57 @@
+#pragma once
+
+#include <volk.h>
+#include <stdbool.h>
+
+// Size of the device memory blocks that allocations are carved out of. Larger resources get
+// a block of their own.
+#define MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
+
+struct VkMemoryRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+// A single vkAllocateMemory allocation with a free list sorted by offset.
+struct VkMemoryBlock {
+    VkDeviceMemory memory;
+    uint32_t type_index;
+    VkDeviceSize size;
+    uint8_t* mapped;
+    struct VkMemoryRange* free_ranges;
+    uint32_t num_free_ranges;
+    uint32_t free_capacity;
+};
+
+// A range of a memory block, bind resources at memory + offset.
+struct VkAllocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t block;
+    // Host pointer to the start of the range for host visible memory, NULL otherwise.
+    uint8_t* mapped;
+};
+
+// Sub-allocates device memory out of large blocks. Blocks are kept around once emptied, so
+// recreating resources of a similar size never reaches the driver.
+struct VkAllocator {
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties properties;
+    VkDeviceSize granularity;
+    struct VkMemoryBlock* blocks;
+    uint32_t num_blocks;
+};
+
+void create_allocator(VkPhysicalDevice physical_device, VkDevice device, struct VkAllocator* out_allocator);
+
+// Returns the index of a memory type allowed by type_bits that has all of the wanted properties.
+uint32_t allocator_find_type(const struct VkAllocator* allocator, uint32_t type_bits, VkMemoryPropertyFlags wanted);
+
+// Host visible memory is mapped for the lifetime of its block.
+bool allocate_memory(struct VkAllocator* allocator, const VkMemoryRequirements* requirements,
+                     VkMemoryPropertyFlags wanted, struct VkAllocation* out_allocation);
+
+void free_memory(struct VkAllocator* allocator, const struct VkAllocation* allocation);
+
+void destroy_allocator(const struct VkAllocator* allocator);
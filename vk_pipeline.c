@@ -1,10 +1,26 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <unistd.h>
 #include "vk_pipeline.h"
 #include "vk_device.h"
 
+#define PIPELINE_CACHE_MAGIC 0x48324443
+
+// Written in front of the driver's cache data. The driver header doesn't cover the driver version.
+struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t driver_version;
+    uint64_t data_size;
+};
+
 void create_pipeline(const struct VkContext* context, struct VkCompPipeline* out_pipeline,
                      VkDescriptorSetLayout desc_layout, const uint32_t* code, uint32_t code_size) {
     out_pipeline->context = context;
+    out_pipeline->required_subgroup_size = 0;
+    out_pipeline->num_variants = 0;
 
     const VkShaderModuleCreateInfo shader_ci = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -19,25 +35,55 @@ void create_pipeline(const struct VkContext* context, struct VkCompPipeline* out
         return;
     }
 
-    const VkPushConstantRange push_range = {
-        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-        .offset = 0U,
-        .size = sizeof(struct PushConstants),
-    };
-
     const VkPipelineLayoutCreateInfo layout_ci = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = NULL,
         .setLayoutCount = 1U,
         .pSetLayouts = &desc_layout,
-        .pushConstantRangeCount = 1U,
-        .pPushConstantRanges = &push_range,
+        .pushConstantRangeCount = 0U,
+        .pPushConstantRanges = NULL,
     };
     result = vkCreatePipelineLayout(context->device, &layout_ci, NULL, &out_pipeline->layout);
     if (result != VK_SUCCESS) {
         printf("Unable to create pipeline layout with result %d\n", result);
-        return;
     }
+}
+
+VkPipeline get_pipeline(struct VkCompPipeline* pipeline, const struct SpecConstants* spec) {
+    for (uint32_t i = 0; i < pipeline->num_variants; i++) {
+        if (memcmp(&pipeline->keys[i], spec, sizeof(*spec)) == 0) {
+            return pipeline->variants[i];
+        }
+    }
+    if (pipeline->num_variants == MAX_PIPELINE_VARIANTS) {
+        printf("Unable to specialize more than %d pipeline variants\n", MAX_PIPELINE_VARIANTS);
+        return VK_NULL_HANDLE;
+    }
+
+    // Entries for constants a shader doesn't declare are ignored.
+    const VkSpecializationMapEntry map_entries[8] = {
+        {0U, offsetof(struct SpecConstants, local_size_x), sizeof(uint32_t)},
+        {1U, offsetof(struct SpecConstants, local_size_y), sizeof(uint32_t)},
+        {2U, offsetof(struct SpecConstants, block_dim), sizeof(int32_t)},
+        {3U, offsetof(struct SpecConstants, level), sizeof(int32_t)},
+        {4U, offsetof(struct SpecConstants, format), sizeof(int32_t)},
+        {5U, offsetof(struct SpecConstants, wavelet), sizeof(int32_t)},
+        {6U, offsetof(struct SpecConstants, width), sizeof(int32_t)},
+        {7U, offsetof(struct SpecConstants, height), sizeof(int32_t)},
+    };
+    const VkSpecializationInfo specialization_info = {
+        .mapEntryCount = 8U,
+        .pMapEntries = map_entries,
+        .dataSize = sizeof(*spec),
+        .pData = spec,
+    };
+
+    const VkPipelineShaderStageRequiredSubgroupSizeCreateInfo subgroup_size_ci = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
+        .pNext = NULL,
+        .requiredSubgroupSize = pipeline->required_subgroup_size,
+    };
+    const bool full_subgroups = pipeline->required_subgroup_size != 0;
 
     const VkComputePipelineCreateInfo comp_pipeline_ci = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
@@ -45,26 +91,129 @@ void create_pipeline(const struct VkContext* context, struct VkCompPipeline* out
         .flags = 0,
         .stage = {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .pNext = NULL,
-            .flags = 0,
+            .pNext = full_subgroups ? &subgroup_size_ci : NULL,
+            .flags = full_subgroups ? VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT : 0,
             .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-            .module = out_pipeline->shader_module,
+            .module = pipeline->shader_module,
             .pName = "main",
-            .pSpecializationInfo = NULL,
+            .pSpecializationInfo = &specialization_info,
         },
-        .layout = out_pipeline->layout,
+        .layout = pipeline->layout,
         .basePipelineHandle = VK_NULL_HANDLE,
         .basePipelineIndex = 0,
     };
-    result = vkCreateComputePipelines(context->device, VK_NULL_HANDLE, 1U, &comp_pipeline_ci, NULL, &out_pipeline->pipeline);
+    VkPipeline variant = VK_NULL_HANDLE;
+    const VkResult result = vkCreateComputePipelines(pipeline->context->device, pipeline->context->pipeline_cache, 1U,
+                                                     &comp_pipeline_ci, NULL, &variant);
     if (result != VK_SUCCESS) {
         printf("Unable to create compute pipeline with result %d\n", result);
+        return VK_NULL_HANDLE;
+    }
+
+    pipeline->keys[pipeline->num_variants] = *spec;
+    pipeline->variants[pipeline->num_variants++] = variant;
+    return variant;
+}
+
+// Drivers reject or, worse, misbehave on data from another device, so check everything we can.
+static bool is_cache_compatible(const VkPhysicalDeviceProperties* properties,
+                                const struct PipelineCacheFileHeader* file_header, const uint8_t* data) {
+    if (file_header->magic != PIPELINE_CACHE_MAGIC || file_header->driver_version != properties->driverVersion ||
+        file_header->data_size < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        return false;
+    }
+
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, data, sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties->vendorID && header.deviceID == properties->deviceID &&
+           memcmp(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache load_pipeline_cache(const struct VkContext* context, const char* path) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+
+    uint8_t* data = NULL;
+    size_t data_size = 0;
+    FILE* file = fopen(path, "rb");
+    if (file) {
+        struct PipelineCacheFileHeader file_header;
+        if (fread(&file_header, sizeof(file_header), 1, file) == 1 && file_header.data_size < (1ULL << 30)) {
+            data = (uint8_t*)malloc(file_header.data_size);
+            data_size = fread(data, 1, file_header.data_size, file);
+            if (data_size != file_header.data_size || !is_cache_compatible(&properties, &file_header, data)) {
+                printf("Ignoring stale pipeline cache %s\n", path);
+                data_size = 0;
+            }
+        }
+        fclose(file);
+    }
+
+    const VkPipelineCacheCreateInfo cache_ci = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = data_size,
+        .pInitialData = data_size ? data : NULL,
+    };
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    const VkResult result = vkCreatePipelineCache(context->device, &cache_ci, NULL, &cache);
+    if (result != VK_SUCCESS) {
+        printf("Unable to create pipeline cache with result %d\n", result);
     }
+
+    free(data);
+    return cache;
+}
+
+void save_pipeline_cache(const struct VkContext* context, VkPipelineCache cache, const char* path) {
+    if (cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    size_t data_size = 0;
+    vkGetPipelineCacheData(context->device, cache, &data_size, NULL);
+    uint8_t* data = (uint8_t*)malloc(data_size);
+    VkResult result = vkGetPipelineCacheData(context->device, cache, &data_size, data);
+    if (result != VK_SUCCESS) {
+        printf("Unable to get pipeline cache data with result %d\n", result);
+        free(data);
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+    const struct PipelineCacheFileHeader file_header = {
+        .magic = PIPELINE_CACHE_MAGIC,
+        .driver_version = properties.driverVersion,
+        .data_size = data_size,
+    };
+
+    // Several processes may exit at the same time, write to a private file and rename it over
+    // the old one so readers never see a partial cache.
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE* file = fopen(tmp_path, "wb");
+    if (!file) {
+        printf("Unable to write pipeline cache %s\n", tmp_path);
+        free(data);
+        return;
+    }
+    const bool written = fwrite(&file_header, sizeof(file_header), 1, file) == 1 &&
+                         fwrite(data, 1, data_size, file) == data_size;
+    if (fclose(file) != 0 || !written || rename(tmp_path, path) != 0) {
+        printf("Unable to write pipeline cache %s\n", path);
+        remove(tmp_path);
+    }
+    free(data);
 }
 
 void destroy_pipeline(const struct VkCompPipeline* pipeline) {
     const VkDevice device = pipeline->context->device;
-    vkDestroyPipeline(device, pipeline->pipeline, NULL);
+    for (uint32_t i = 0; i < pipeline->num_variants; i++) {
+        vkDestroyPipeline(device, pipeline->variants[i], NULL);
+    }
     vkDestroyPipelineLayout(device, pipeline->layout, NULL);
     vkDestroyShaderModule(device, pipeline->shader_module, NULL);
 }
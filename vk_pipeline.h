@@ -4,19 +4,47 @@
 
 struct VkContext;
 
+#define MAX_PIPELINE_VARIANTS 16
+
+// Values baked into a pipeline with the specialization constants 0 to 7 of the shaders.
+struct SpecConstants {
+    uint32_t local_size_x;
+    uint32_t local_size_y;
+    int32_t block_dim;
+    int32_t level;
+    // Layout of the data the shader reads or writes, the meaning is up to each shader.
+    int32_t format;
+    // Wavelet implemented by the lifting steps.
+    int32_t wavelet;
+    // Frame size for shaders that access frames in buffers, which have no size to query.
+    int32_t width;
+    int32_t height;
+};
+
+// A compute shader along with the variants of it that have been specialized so far.
 struct VkCompPipeline {
     const struct VkContext* context;
     VkPipelineLayout layout;
-    VkPipeline pipeline;
     VkShaderModule shader_module;
-};
-
-struct PushConstants {
-    int level;
-    int block_dim;
+    // Subgroup size the variants are created with, every subgroup being full. Zero leaves the
+    // subgroups up to the driver.
+    uint32_t required_subgroup_size;
+    struct SpecConstants keys[MAX_PIPELINE_VARIANTS];
+    VkPipeline variants[MAX_PIPELINE_VARIANTS];
+    uint32_t num_variants;
 };
 
 void create_pipeline(const struct VkContext* context, struct VkCompPipeline* out_pipeline,
                      VkDescriptorSetLayout desc_layout, const uint32_t* code, uint32_t code_size);
 
+// Returns the variant of the pipeline specialized with spec, creating it on first use.
+VkPipeline get_pipeline(struct VkCompPipeline* pipeline, const struct SpecConstants* spec);
+
+// Creates a pipeline cache seeded from the file at path, if it was written for the same device and
+// driver. Otherwise the cache starts out empty.
+VkPipelineCache load_pipeline_cache(const struct VkContext* context, const char* path);
+
+// Writes the cache contents to path, replacing the previous file atomically.
+void save_pipeline_cache(const struct VkContext* context, VkPipelineCache cache, const char* path);
+
 void destroy_pipeline(const struct VkCompPipeline* pipeline);
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vk_profiler.h"
+#include "vk_device.h"
+
+void create_profiler(const struct VkContext* context, struct VkProfiler* out_profiler, uint32_t num_slots) {
+    memset(out_profiler, 0, sizeof(*out_profiler));
+    out_profiler->context = context;
+    out_profiler->num_slots = num_slots < MAX_PROFILER_SLOTS ? num_slots : MAX_PROFILER_SLOTS;
+
+    // Timestamps are only usable if every queue family we submit to supports them.
+    uint32_t queue_family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physical_device, &queue_family_count, NULL);
+    VkQueueFamilyProperties* family_properties = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(context->physical_device, &queue_family_count, family_properties);
+    uint32_t valid_bits = 64;
+    for (uint32_t type = 0; type < NUM_QUEUE_TYPES; type++) {
+        const uint32_t family = context->queues[type].family;
+        if (family_properties[family].timestampValidBits < valid_bits) {
+            valid_bits = family_properties[family].timestampValidBits;
+        }
+        if (valid_bits == 0) {
+            printf("Queue family %u does not support timestamps, profiling is disabled\n", family);
+            free(family_properties);
+            return;
+        }
+    }
+    free(family_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+    out_profiler->timestamp_period = properties.limits.timestampPeriod;
+    out_profiler->timestamp_mask = valid_bits == 64 ? UINT64_MAX : ((1ULL << valid_bits) - 1);
+
+    const VkQueryPoolCreateInfo query_pool_ci = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = out_profiler->num_slots * MAX_PROFILER_STAGES * 2,
+    };
+    VkResult result = vkCreateQueryPool(context->device, &query_pool_ci, NULL, &out_profiler->query_pool);
+    if (result != VK_SUCCESS) {
+        printf("Unable to create query pool with result %d\n", result);
+        return;
+    }
+
+    out_profiler->enabled = true;
+}
+
+// Index of the first query of a slot in the pool.
+static uint32_t slot_base(uint32_t slot) {
+    return slot * MAX_PROFILER_STAGES * 2;
+}
+
+void profiler_reset(struct VkProfiler* profiler, uint32_t slot) {
+    if (!profiler->enabled) {
+        return;
+    }
+    profiler->slot = slot % profiler->num_slots;
+    vkResetQueryPool(profiler->context->device, profiler->query_pool, slot_base(profiler->slot), MAX_PROFILER_STAGES * 2);
+    profiler->num_queries[profiler->slot] = 0;
+}
+
+void profiler_discard(struct VkProfiler* profiler, uint32_t slot) {
+    if (!profiler->enabled) {
+        return;
+    }
+    profiler->num_queries[slot % profiler->num_slots] = 0;
+}
+
+static uint32_t find_stage(struct VkProfiler* profiler, const char* name) {
+    for (uint32_t i = 0; i < profiler->num_stages; i++) {
+        if (strcmp(profiler->stages[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (profiler->num_stages == MAX_PROFILER_STAGES) {
+        return UINT32_MAX;
+    }
+
+    struct VkProfilerStage* stage = &profiler->stages[profiler->num_stages];
+    stage->name = name;
+    stage->samples = NULL;
+    stage->num_samples = 0;
+    stage->capacity = 0;
+    return profiler->num_stages++;
+}
+
+void profiler_begin(VkCommandBuffer cmdbuf, struct VkProfiler* profiler, const char* name) {
+    if (!profiler->enabled) {
+        return;
+    }
+
+    const uint32_t stage = find_stage(profiler, name);
+    const uint32_t num_queries = profiler->num_queries[profiler->slot];
+    if (stage == UINT32_MAX || num_queries == MAX_PROFILER_STAGES) {
+        printf("Too many profiler stages, ignoring %s\n", name);
+        return;
+    }
+
+    // The timestamp is taken once the work recorded before has finished, so a stage is measured from
+    // the end of prior work. Nothing holds the stage back until then, so it may overlap that work.
+    profiler->query_stages[profiler->slot][num_queries] = stage;
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->query_pool,
+                        slot_base(profiler->slot) + num_queries * 2);
+    profiler->in_stage = true;
+}
+
+void profiler_end(VkCommandBuffer cmdbuf, struct VkProfiler* profiler) {
+    if (!profiler->in_stage) {
+        return;
+    }
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->query_pool,
+                        slot_base(profiler->slot) + profiler->num_queries[profiler->slot] * 2 + 1);
+    profiler->num_queries[profiler->slot]++;
+    profiler->in_stage = false;
+}
+
+void profiler_collect(struct VkProfiler* profiler, uint32_t slot) {
+    if (!profiler->enabled) {
+        return;
+    }
+    slot %= profiler->num_slots;
+    const uint32_t num_queries = profiler->num_queries[slot];
+    if (num_queries == 0) {
+        return;
+    }
+
+    uint64_t timestamps[MAX_PROFILER_STAGES * 2];
+    const VkResult result = vkGetQueryPoolResults(profiler->context->device, profiler->query_pool, slot_base(slot),
+                                                  num_queries * 2, sizeof(timestamps), timestamps,
+                                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    if (result != VK_SUCCESS) {
+        printf("Unable to get timestamp results with result %d\n", result);
+        return;
+    }
+
+    for (uint32_t i = 0; i < num_queries; i++) {
+        struct VkProfilerStage* stage = &profiler->stages[profiler->query_stages[slot][i]];
+        if (stage->num_samples == stage->capacity) {
+            stage->capacity = stage->capacity ? stage->capacity * 2 : 64;
+            stage->samples = (double*)realloc(stage->samples, sizeof(double) * stage->capacity);
+        }
+
+        const uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & profiler->timestamp_mask;
+        stage->samples[stage->num_samples++] = ticks * profiler->timestamp_period / 1e6;
+    }
+    profiler->num_queries[slot] = 0;
+}
+
+static int compare_samples(const void* a, const void* b) {
+    const double lhs = *(const double*)a;
+    const double rhs = *(const double*)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+void profiler_report(const struct VkProfiler* profiler) {
+    if (!profiler->enabled) {
+        return;
+    }
+
+    printf("%-20s %8s %10s %10s %10s\n", "stage", "samples", "min (ms)", "avg (ms)", "p99 (ms)");
+    for (uint32_t i = 0; i < profiler->num_stages; i++) {
+        const struct VkProfilerStage* stage = &profiler->stages[i];
+        if (stage->num_samples == 0) {
+            continue;
+        }
+
+        double* sorted = (double*)malloc(sizeof(double) * stage->num_samples);
+        memcpy(sorted, stage->samples, sizeof(double) * stage->num_samples);
+        qsort(sorted, stage->num_samples, sizeof(double), compare_samples);
+
+        double total = 0.0;
+        for (uint32_t j = 0; j < stage->num_samples; j++) {
+            total += sorted[j];
+        }
+        const uint32_t p99_index = (uint32_t)((stage->num_samples - 1) * 0.99);
+        printf("%-20s %8u %10.3f %10.3f %10.3f\n", stage->name, stage->num_samples, sorted[0],
+               total / stage->num_samples, sorted[p99_index]);
+        free(sorted);
+    }
+}
+
+void destroy_profiler(const struct VkProfiler* profiler) {
+    for (uint32_t i = 0; i < profiler->num_stages; i++) {
+        free(profiler->stages[i].samples);
+    }
+    if (profiler->enabled) {
+        vkDestroyQueryPool(profiler->context->device, profiler->query_pool, NULL);
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <volk.h>
+#include <stdbool.h>
+
+struct VkContext;
+
+#define MAX_PROFILER_STAGES 16
+// Submissions that can be in flight at the same time, each with its own range of queries.
+#define MAX_PROFILER_SLOTS 8
+
+// Durations of every recorded instance of a stage, in milliseconds.
+struct VkProfilerStage {
+    const char* name;
+    double* samples;
+    uint32_t num_samples;
+    uint32_t capacity;
+};
+
+// Measures GPU execution time of command buffer regions with timestamp queries.
+struct VkProfiler {
+    const struct VkContext* context;
+    bool enabled;
+    VkQueryPool query_pool;
+    float timestamp_period;
+    uint64_t timestamp_mask;
+    struct VkProfilerStage stages[MAX_PROFILER_STAGES];
+    uint32_t num_stages;
+    uint32_t num_slots;
+    // Slot the stages are currently recorded to.
+    uint32_t slot;
+    // Stage index of each begin/end query pair recorded since the last reset of a slot.
+    uint32_t query_stages[MAX_PROFILER_SLOTS][MAX_PROFILER_STAGES];
+    uint32_t num_queries[MAX_PROFILER_SLOTS];
+    bool in_stage;
+};
+
+void create_profiler(const struct VkContext* context, struct VkProfiler* out_profiler, uint32_t num_slots);
+
+// Resets a slot from the host before recording the stages of a submission, the previous submission
+// of the slot must have completed and its results must have been collected. Stages recorded until
+// the next reset go to this slot, they may be spread over command buffers of different queues.
+void profiler_reset(struct VkProfiler* profiler, uint32_t slot);
+
+// Forgets the stages recorded to a slot, so the next collect skips them, without touching the
+// queries. Safe while the submission of the slot is still in flight.
+void profiler_discard(struct VkProfiler* profiler, uint32_t slot);
+
+// Brackets the commands recorded in between as an instance of the named stage. The name must
+// outlive the profiler.
+void profiler_begin(VkCommandBuffer cmdbuf, struct VkProfiler* profiler, const char* name);
+
+void profiler_end(VkCommandBuffer cmdbuf, struct VkProfiler* profiler);
+
+// Reads back the timestamps of the completed submission in a slot and adds them to the stage statistics.
+void profiler_collect(struct VkProfiler* profiler, uint32_t slot);
+
+// Prints min/avg/p99 of every stage.
+void profiler_report(const struct VkProfiler* profiler);
+
+void destroy_profiler(const struct VkProfiler* profiler);
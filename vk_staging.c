@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include "vk_staging.h"
+#include "vk_device.h"
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Gathers the distinct queue families of the context, which share slices concurrently.
+static uint32_t queue_families(const struct VkContext* context, uint32_t* out_families) {
+    uint32_t num_families = 0;
+    for (uint32_t type = 0; type < NUM_QUEUE_TYPES; type++) {
+        uint32_t i = 0;
+        while (i < num_families && out_families[i] != context->queues[type].family) {
+            i++;
+        }
+        if (i == num_families) {
+            out_families[num_families++] = context->queues[type].family;
+        }
+    }
+    return num_families;
+}
+
+void create_staging_ring(struct VkContext* context, struct VkStagingRing* out_ring, VkDeviceSize size) {
+    out_ring->context = context;
+    out_ring->device = context->device;
+    out_ring->allocator = &context->allocator;
+    out_ring->size = size;
+    out_ring->head = 0;
+    out_ring->tail = 0;
+    out_ring->has_open_slices = false;
+    out_ring->first_frame = 0;
+    out_ring->num_frames = 0;
+
+    // Slice offsets are used as copy offsets and as dynamic storage buffer offsets, so respect the
+    // alignment the device requires for both.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->physical_device, &properties);
+    out_ring->alignment = properties.limits.optimalBufferCopyOffsetAlignment;
+    if (out_ring->alignment < properties.limits.minStorageBufferOffsetAlignment) {
+        out_ring->alignment = properties.limits.minStorageBufferOffsetAlignment;
+    }
+    if (out_ring->alignment < 16) {
+        out_ring->alignment = 16;
+    }
+
+    // Slices are used from every queue, sharing the buffer avoids ownership transfers for each of them.
+    uint32_t families[NUM_QUEUE_TYPES];
+    const uint32_t num_families = queue_families(context, families);
+
+    const VkBufferCreateInfo buffer_ci = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = num_families > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = num_families > 1 ? num_families : 0U,
+        .pQueueFamilyIndices = num_families > 1 ? families : NULL,
+    };
+    VkResult result = vkCreateBuffer(context->device, &buffer_ci, NULL, &out_ring->buffer);
+    if (result != VK_SUCCESS) {
+        printf("Unable to create staging buffer with result %d\n", result);
+        return;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context->device, out_ring->buffer, &requirements);
+
+    // Readbacks are read in place by the host, which is far slower from uncached memory. Uploads are
+    // written once either way, so prefer cached memory whenever there is a type with it.
+    VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkPhysicalDeviceMemoryProperties* memory_properties = &context->allocator.properties;
+    for (uint32_t i = 0; i < memory_properties->memoryTypeCount; i++) {
+        const VkMemoryPropertyFlags cached = wanted | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        if ((requirements.memoryTypeBits & (1U << i)) &&
+            (memory_properties->memoryTypes[i].propertyFlags & cached) == cached) {
+            wanted = cached;
+            break;
+        }
+    }
+
+    if (!allocate_memory(&context->allocator, &requirements, wanted, &out_ring->memory)) {
+        printf("Unable to allocate staging memory\n");
+        return;
+    }
+
+    vkBindBufferMemory(context->device, out_ring->buffer, out_ring->memory.memory, out_ring->memory.offset);
+    out_ring->mapped = out_ring->memory.mapped;
+}
+
+// Recycles completed frames in submission order, stopping at the first one still in use.
+static void reclaim_frames(struct VkStagingRing* ring) {
+    while (ring->num_frames > 0) {
+        const struct VkStagingFrame* frame = &ring->frames[ring->first_frame];
+        if (frame->held || !timeline_reached(ring->context, frame->value)) {
+            break;
+        }
+        ring->tail = frame->end;
+        ring->first_frame = (ring->first_frame + 1) % MAX_STAGING_FRAMES;
+        ring->num_frames--;
+    }
+
+    // Start over from the beginning when nothing is in use to avoid needless wrapping.
+    if (ring->num_frames == 0 && !ring->has_open_slices) {
+        ring->head = 0;
+        ring->tail = 0;
+    }
+}
+
+static bool try_fit(const struct VkStagingRing* ring, VkDeviceSize size, VkDeviceSize* out_offset) {
+    const bool empty = ring->num_frames == 0 && !ring->has_open_slices;
+    if (empty) {
+        *out_offset = 0;
+        return size <= ring->size;
+    }
+
+    const VkDeviceSize offset = align_up(ring->head, ring->alignment);
+    if (ring->head < ring->tail) {
+        *out_offset = offset;
+        return offset + size <= ring->tail;
+    }
+    if (ring->head == ring->tail) {
+        return false;
+    }
+
+    // Use the space after the head, otherwise wrap around to the space before the tail.
+    if (offset + size <= ring->size) {
+        *out_offset = offset;
+        return true;
+    }
+    *out_offset = 0;
+    return size <= ring->tail;
+}
+
+bool staging_alloc(struct VkStagingRing* ring, VkDeviceSize size, struct VkStagingSlice* out_slice) {
+    for (;;) {
+        reclaim_frames(ring);
+
+        VkDeviceSize offset;
+        if (try_fit(ring, size, &offset)) {
+            ring->head = offset + size;
+            ring->has_open_slices = true;
+            out_slice->buffer = ring->buffer;
+            out_slice->offset = offset;
+            out_slice->size = size;
+            out_slice->data = ring->mapped + offset;
+            return true;
+        }
+
+        // Nothing left to wait for, the request can't be satisfied.
+        if (ring->num_frames == 0 || ring->frames[ring->first_frame].held) {
+            printf("Staging ring is out of space for %llu bytes\n", (unsigned long long)size);
+            return false;
+        }
+        timeline_wait(ring->context, ring->frames[ring->first_frame].value);
+    }
+}
+
+bool staging_end_frame(struct VkStagingRing* ring, uint64_t value, bool hold) {
+    if (ring->num_frames == MAX_STAGING_FRAMES) {
+        if (!ring->frames[ring->first_frame].held) {
+            timeline_wait(ring->context, ring->frames[ring->first_frame].value);
+        }
+        reclaim_frames(ring);
+        if (ring->num_frames == MAX_STAGING_FRAMES) {
+            // Leave the slices open, they are recycled along with the next frame that gets closed.
+            // A hold is lost, so the caller has to give up on reading them back.
+            if (hold) {
+                printf("Too many staging frames are held, unable to hold frame %llu\n", (unsigned long long)value);
+            }
+            return !hold;
+        }
+    }
+
+    struct VkStagingFrame* frame = &ring->frames[(ring->first_frame + ring->num_frames) % MAX_STAGING_FRAMES];
+    frame->end = ring->head;
+    frame->value = value;
+    frame->held = hold;
+    ring->num_frames++;
+    ring->has_open_slices = false;
+    return true;
+}
+
+void staging_release(struct VkStagingRing* ring, uint64_t value) {
+    for (uint32_t i = 0; i < ring->num_frames; i++) {
+        struct VkStagingFrame* frame = &ring->frames[(ring->first_frame + i) % MAX_STAGING_FRAMES];
+        if (frame->value == value) {
+            frame->held = false;
+            break;
+        }
+    }
+    reclaim_frames(ring);
+}
+
+void destroy_staging_ring(const struct VkStagingRing* ring) {
+    vkDestroyBuffer(ring->device, ring->buffer, NULL);
+    free_memory(ring->allocator, &ring->memory);
+}
+
+bool import_host_memory(struct VkContext* context, uint8_t* data, VkDeviceSize size, struct VkHostImport* out_import,
+                        struct VkStagingSlice* out_slice) {
+    const VkDeviceSize alignment = context->host_import_alignment;
+    if (!context->external_memory_host || size == 0 || (uintptr_t)data % alignment != 0 || size % alignment != 0) {
+        return false;
+    }
+
+    // Not every allocation can be imported, drivers only accept memory they can map for the device.
+    VkMemoryHostPointerPropertiesEXT pointer_properties = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+        .pNext = NULL,
+        .memoryTypeBits = 0,
+    };
+    VkResult result = vkGetMemoryHostPointerPropertiesEXT(context->device,
+                                                          VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                                                          data, &pointer_properties);
+    if (result != VK_SUCCESS || pointer_properties.memoryTypeBits == 0) {
+        return false;
+    }
+
+    uint32_t families[NUM_QUEUE_TYPES];
+    const uint32_t num_families = queue_families(context, families);
+    const VkExternalMemoryBufferCreateInfo external_ci = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+    };
+    const VkBufferCreateInfo buffer_ci = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = &external_ci,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = num_families > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = num_families > 1 ? num_families : 0U,
+        .pQueueFamilyIndices = num_families > 1 ? families : NULL,
+    };
+    result = vkCreateBuffer(context->device, &buffer_ci, NULL, &out_import->buffer);
+    if (result != VK_SUCCESS) {
+        printf("Unable to create imported host buffer with result %d\n", result);
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context->device, out_import->buffer, &requirements);
+    const uint32_t type_bits = requirements.memoryTypeBits & pointer_properties.memoryTypeBits;
+    const uint32_t type_index = type_bits ? allocator_find_type(&context->allocator, type_bits, 0) : UINT32_MAX;
+    if (type_index == UINT32_MAX) {
+        vkDestroyBuffer(context->device, out_import->buffer, NULL);
+        out_import->buffer = VK_NULL_HANDLE;
+        return false;
+    }
+
+    // Imports can't be sub-allocated, every one is an allocation of its own.
+    const VkImportMemoryHostPointerInfoEXT import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+        .pNext = NULL,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        .pHostPointer = data,
+    };
+    const VkMemoryAllocateInfo allocate_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &import_info,
+        .allocationSize = size,
+        .memoryTypeIndex = type_index,
+    };
+    result = vkAllocateMemory(context->device, &allocate_info, NULL, &out_import->memory);
+    if (result != VK_SUCCESS) {
+        printf("Unable to import host memory with result %d\n", result);
+        vkDestroyBuffer(context->device, out_import->buffer, NULL);
+        out_import->buffer = VK_NULL_HANDLE;
+        return false;
+    }
+    vkBindBufferMemory(context->device, out_import->buffer, out_import->memory, 0);
+
+    out_slice->buffer = out_import->buffer;
+    out_slice->offset = 0;
+    out_slice->size = size;
+    out_slice->data = data;
+    return true;
+}
+
+void release_host_import(VkDevice device, struct VkHostImport* import) {
+    vkDestroyBuffer(device, import->buffer, NULL);
+    vkFreeMemory(device, import->memory, NULL);
+    import->buffer = VK_NULL_HANDLE;
+    import->memory = VK_NULL_HANDLE;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <volk.h>
+#include <stdbool.h>
+#include "vk_memory.h"
+
+struct VkContext;
+
+#define STAGING_RING_SIZE (64 * 1024 * 1024)
+#define MAX_STAGING_FRAMES 16
+
+// A host visible range of the staging ring.
+struct VkStagingSlice {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint8_t* data;
+};
+
+// Allocations made between two staging_end_frame calls, recycled together once the timeline
+// point of the last submission using them is reached.
+struct VkStagingFrame {
+    uint64_t value;
+    VkDeviceSize end;
+    bool held;
+};
+
+// Host visible buffer shared by all uploads and readbacks of a context. Slices are handed out
+// linearly and recycled in submission order once the GPU is done with them.
+struct VkStagingRing {
+    const struct VkContext* context;
+    VkDevice device;
+    struct VkAllocator* allocator;
+    VkBuffer buffer;
+    struct VkAllocation memory;
+    uint8_t* mapped;
+    VkDeviceSize size;
+    VkDeviceSize alignment;
+    VkDeviceSize head;
+    VkDeviceSize tail;
+    bool has_open_slices;
+    struct VkStagingFrame frames[MAX_STAGING_FRAMES];
+    uint32_t first_frame;
+    uint32_t num_frames;
+};
+
+void create_staging_ring(struct VkContext* context, struct VkStagingRing* out_ring, VkDeviceSize size);
+
+// Hands out a slice of at least size bytes, waiting for older frames to complete if the ring is full.
+bool staging_alloc(struct VkStagingRing* ring, VkDeviceSize size, struct VkStagingSlice* out_slice);
+
+// Closes the frame containing every slice allocated since the last call, value is the timeline
+// point of the last submission using them. Frames that are held also need staging_release before
+// they are recycled, which allows reading back results after the submission has completed. Returns
+// false when a frame can't be held because MAX_STAGING_FRAMES frames are held already, its slices
+// are then recycled along with the next frame that gets closed and must not be read back.
+bool staging_end_frame(struct VkStagingRing* ring, uint64_t value, bool hold);
+
+void staging_release(struct VkStagingRing* ring, uint64_t value);
+
+void destroy_staging_ring(const struct VkStagingRing* ring);
+
+// Host allocation imported as device memory and bound to a buffer of its own, so the GPU reads it in
+// place instead of from a copy in the staging ring.
+struct VkHostImport {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+};
+
+// Imports the size bytes at data and hands them out as a slice at offset 0 of the imported buffer.
+// Both data and size must be multiples of context->host_import_alignment. Returns false when the
+// device can't import them, in which case the caller should stage a copy instead.
+// The host memory must stay allocated and unchanged until release_host_import.
+bool import_host_memory(struct VkContext* context, uint8_t* data, VkDeviceSize size, struct VkHostImport* out_import,
+                        struct VkStagingSlice* out_slice);
+
+void release_host_import(VkDevice device, struct VkHostImport* import);
@@ -42,7 +42,7 @@ VkFormat find_present_format(VkPhysicalDevice physical_device, VkSurfaceKHR surf
 }
 
 void create_window(const struct VkContext* context_, struct VkWindow* out_window,
-                   uint32_t width, uint32_t height) {
+                   uint32_t width, uint32_t height, uint32_t num_frames) {
     context = context_;
 
     // Create GLFW window and create a vulkan surface from it.
@@ -118,20 +118,17 @@ void create_window(const struct VkContext* context_, struct VkWindow* out_window
         .flags = 0,
     };
 
-    const VkFenceCreateInfo fence_ci = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-    };
-
-    VkSemaphore* image_acquired = (VkSemaphore*)malloc(sizeof(VkSemaphore) * num_swapchain_images);
+    // A present semaphore can only be reused once its image has been acquired again, so there is
+    // one per image. Everything else is per frame in flight.
     VkSemaphore* present_ready = (VkSemaphore*)malloc(sizeof(VkSemaphore) * num_swapchain_images);
-    VkFence* fences = (VkFence*)malloc(sizeof(VkFence) * num_swapchain_images);
-
     for (uint32_t i = 0; i < num_swapchain_images; i++) {
-        vkCreateSemaphore(context->device, &semaphore_ci, NULL, &image_acquired[i]);
         vkCreateSemaphore(context->device, &semaphore_ci, NULL, &present_ready[i]);
-        vkCreateFence(context->device, &fence_ci, NULL, &fences[i]);
+    }
+
+    VkSemaphore* image_acquired = (VkSemaphore*)malloc(sizeof(VkSemaphore) * num_frames);
+    uint64_t* frame_values = (uint64_t*)calloc(num_frames, sizeof(uint64_t));
+    for (uint32_t i = 0; i < num_frames; i++) {
+        vkCreateSemaphore(context->device, &semaphore_ci, NULL, &image_acquired[i]);
     }
 
     out_window->window = window;
@@ -143,19 +140,21 @@ void create_window(const struct VkContext* context_, struct VkWindow* out_window
     out_window->images = images;
     out_window->image_acquired = image_acquired;
     out_window->present_ready = present_ready;
-    out_window->fences = fences;
+    out_window->frame_values = frame_values;
+    out_window->num_frames = num_frames;
     out_window->frame_index = 0;
 }
 
 void destroy_window(const struct VkWindow* window) {
     for (uint32_t i = 0; i < window->num_images; i++) {
-        vkDestroySemaphore(context->device, window->image_acquired[i], NULL);
         vkDestroySemaphore(context->device, window->present_ready[i], NULL);
-        vkDestroyFence(context->device, window->fences[i], NULL);
+    }
+    for (uint32_t i = 0; i < window->num_frames; i++) {
+        vkDestroySemaphore(context->device, window->image_acquired[i], NULL);
     }
     free(window->image_acquired);
     free(window->present_ready);
-    free(window->fences);
+    free(window->frame_values);
     free(window->images);
     vkDestroySwapchainKHR(context->device, window->swapchain, NULL);
     vkDestroySurfaceKHR(context->instance, window->surface, NULL);
@@ -177,7 +176,7 @@ void present(struct VkWindow* window) {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .pNext = NULL,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &window->present_ready[window->frame_index],
+        .pWaitSemaphores = &window->present_ready[window->image_index],
         .swapchainCount = 1,
         .pSwapchains = &window->swapchain,
         .pImageIndices = &window->image_index,
@@ -189,5 +188,5 @@ void present(struct VkWindow* window) {
         return;
     }
 
-    window->frame_index = (window->frame_index + 1) % window->num_images;
+    window->frame_index = (window->frame_index + 1) % window->num_frames;
 }
@@ -13,16 +13,20 @@ struct VkWindow {
     uint32_t height;
     uint32_t num_images;
     VkImage* images;
-    VkSemaphore* image_acquired;
+    // One per swapchain image, signaled when rendering to that image is done.
     VkSemaphore* present_ready;
-    VkFence* fences;
+    // Frames in flight are independent of the swapchain length, each has its own acquire
+    // semaphore and the timeline value of its last submission.
+    uint32_t num_frames;
+    VkSemaphore* image_acquired;
+    uint64_t* frame_values;
     uint32_t frame_index;
     uint32_t image_index;
     VkFormat format;
 };
 
 void create_window(const struct VkContext* context, struct VkWindow* out_window,
-                   uint32_t width, uint32_t height);
+                   uint32_t width, uint32_t height, uint32_t num_frames);
 
 void destroy_window(const struct VkWindow* window);
 
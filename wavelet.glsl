@@ -0,0 +1,104 @@
+// Lifting steps of the wavelets longer than Haar, shared by the kernels that keep a block in
+// shared memory. The including shader declares the tile, block_dim, num_invocations and wavelet,
+// and includes coefficients.glsl for the type of the tile.
+
+const int WAVELET_HAAR = 0;
+const int WAVELET_LEGALL_5_3 = 1;
+const int WAVELET_DD_9_7 = 2;
+const int WAVELET_CDF_9_7 = 3;
+
+// Lifting coefficients and scaling of the irreversible CDF 9/7 wavelet of JPEG 2000.
+const float CDF_ALPHA = -1.586134342059924;
+const float CDF_BETA = -0.052980118572961;
+const float CDF_GAMMA = 0.882911075530934;
+const float CDF_DELTA = 0.443506852043971;
+const float CDF_K = 1.230174104914001;
+
+// Blocks are transformed independently, so lines are extended symmetrically about their first and
+// last sample instead of reading from the neighboring blocks.
+int mirror(int k, int n) {
+    const int period = 2 * (n - 1);
+    k = abs(k) % period;
+    return k < n ? k : period - k;
+}
+
+// Tile position of sample k of a line of the current level. The lines along x are the rows holding
+// low-pass samples of the previous level and the lines along y the columns.
+ivec2 line_coord(int axis, int line, int k, int p_offset) {
+    return (axis == 0 ? ivec2(k, line) : ivec2(line, k)) * p_offset;
+}
+
+// Adds the weighted nearest and second nearest samples of the other parity to every sample of the
+// given parity, on all lines of the tile along an axis.
+void lift_step(int axis, int dim, int parity, float near_weight, float far_weight) {
+    const int p_offset = dim >> 1;
+    const int n = block_dim / p_offset;
+    const int half_n = n >> 1;
+    for (int i = int(gl_LocalInvocationIndex); i < half_n * n; i += num_invocations) {
+        // Consecutive invocations work on consecutive columns in the vertical pass to keep shared
+        // memory accesses spread out.
+        const int line = axis == 0 ? i / half_n : i % n;
+        const int k = (axis == 0 ? i % half_n : i / n) * 2 + parity;
+
+        const ivec2 l1 = line_coord(axis, line, mirror(k - 1, n), p_offset);
+        const ivec2 r1 = line_coord(axis, line, mirror(k + 1, n), p_offset);
+        coeff4 sum = coeff(near_weight) * (tile[l1.y][l1.x] + tile[r1.y][r1.x]);
+        if (far_weight != 0.0) {
+            const ivec2 l3 = line_coord(axis, line, mirror(k - 3, n), p_offset);
+            const ivec2 r3 = line_coord(axis, line, mirror(k + 3, n), p_offset);
+            sum += coeff(far_weight) * (tile[l3.y][l3.x] + tile[r3.y][r3.x]);
+        }
+
+        const ivec2 coord = line_coord(axis, line, k, p_offset);
+        tile[coord.y][coord.x] += sum;
+    }
+    barrier();
+}
+
+void scale_step(int axis, int dim, float low_scale, float high_scale) {
+    const int p_offset = dim >> 1;
+    const int n = block_dim / p_offset;
+    for (int i = int(gl_LocalInvocationIndex); i < n * n; i += num_invocations) {
+        const int line = axis == 0 ? i / n : i % n;
+        const int k = axis == 0 ? i % n : i / n;
+        const ivec2 coord = line_coord(axis, line, k, p_offset);
+        tile[coord.y][coord.x] *= coeff((k & 1) == 0 ? low_scale : high_scale);
+    }
+    barrier();
+}
+
+// One level of the forward transform, rows first. The low-pass samples stay at the even and the
+// high-pass samples at the odd positions, like the Haar kernels leave them.
+void wavelet_forward(int dim) {
+    for (int axis = 0; axis < 2; axis++) {
+        if (wavelet == WAVELET_CDF_9_7) {
+            lift_step(axis, dim, 1, CDF_ALPHA, 0.0);
+            lift_step(axis, dim, 0, CDF_BETA, 0.0);
+            lift_step(axis, dim, 1, CDF_GAMMA, 0.0);
+            lift_step(axis, dim, 0, CDF_DELTA, 0.0);
+            scale_step(axis, dim, 1.0 / CDF_K, CDF_K);
+        } else {
+            // Deslauriers-Dubuc predicts from four samples instead of two, both share the update.
+            const bool dd = wavelet == WAVELET_DD_9_7;
+            lift_step(axis, dim, 1, dd ? -9.0 / 16.0 : -0.5, dd ? 1.0 / 16.0 : 0.0);
+            lift_step(axis, dim, 0, 0.25, 0.0);
+        }
+    }
+}
+
+// Undoes wavelet_forward for one level, columns first.
+void wavelet_inverse(int dim) {
+    for (int axis = 1; axis >= 0; axis--) {
+        if (wavelet == WAVELET_CDF_9_7) {
+            scale_step(axis, dim, CDF_K, 1.0 / CDF_K);
+            lift_step(axis, dim, 0, -CDF_DELTA, 0.0);
+            lift_step(axis, dim, 1, -CDF_GAMMA, 0.0);
+            lift_step(axis, dim, 0, -CDF_BETA, 0.0);
+            lift_step(axis, dim, 1, -CDF_ALPHA, 0.0);
+        } else {
+            const bool dd = wavelet == WAVELET_DD_9_7;
+            lift_step(axis, dim, 0, -0.25, 0.0);
+            lift_step(axis, dim, 1, dd ? 9.0 / 16.0 : 0.5, dd ? -1.0 / 16.0 : 0.0);
+        }
+    }
+}
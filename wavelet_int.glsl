@@ -0,0 +1,77 @@
+// Integer lifting steps of the reversible wavelets longer than Haar, as defined by VC-2, shared by
+// the lossless kernels. The including shader declares the tile, block_dim, num_invocations and
+// wavelet. CDF 9/7 has no integer form.
+
+const int WAVELET_HAAR = 0;
+const int WAVELET_LEGALL_5_3 = 1;
+const int WAVELET_DD_9_7 = 2;
+
+// Blocks are transformed independently, so lines are extended symmetrically about their first and
+// last sample instead of reading from the neighboring blocks.
+int mirror(int k, int n) {
+    const int period = 2 * (n - 1);
+    k = abs(k) % period;
+    return k < n ? k : period - k;
+}
+
+// Tile position of sample k of a line of the current level. The lines along x are the rows holding
+// low-pass samples of the previous level and the lines along y the columns.
+ivec2 line_coord(int axis, int line, int k, int p_offset) {
+    return (axis == 0 ? ivec2(k, line) : ivec2(line, k)) * p_offset;
+}
+
+// Adds sign * ((near_weight * near + far_weight * far + rounding) >> shift) to every sample of the
+// given parity. The term only depends on samples of the other parity, so running the step again
+// with the opposite sign restores the samples exactly.
+void lift_step(int axis, int dim, int parity, int sign, int near_weight, int far_weight, int rounding, int shift) {
+    const int p_offset = dim >> 1;
+    const int n = block_dim / p_offset;
+    const int half_n = n >> 1;
+    for (int i = int(gl_LocalInvocationIndex); i < half_n * n; i += num_invocations) {
+        // Consecutive invocations work on consecutive columns in the vertical pass to keep shared
+        // memory accesses spread out.
+        const int line = axis == 0 ? i / half_n : i % n;
+        const int k = (axis == 0 ? i % half_n : i / n) * 2 + parity;
+
+        const ivec2 l1 = line_coord(axis, line, mirror(k - 1, n), p_offset);
+        const ivec2 r1 = line_coord(axis, line, mirror(k + 1, n), p_offset);
+        ivec4 sum = near_weight * (ivec4(tile[l1.y][l1.x]) + ivec4(tile[r1.y][r1.x])) + rounding;
+        if (far_weight != 0) {
+            const ivec2 l3 = line_coord(axis, line, mirror(k - 3, n), p_offset);
+            const ivec2 r3 = line_coord(axis, line, mirror(k + 3, n), p_offset);
+            sum += far_weight * (ivec4(tile[l3.y][l3.x]) + ivec4(tile[r3.y][r3.x]));
+        }
+
+        const ivec2 coord = line_coord(axis, line, k, p_offset);
+        tile[coord.y][coord.x] = icoeff4(ivec4(tile[coord.y][coord.x]) + sign * (sum >> shift));
+    }
+    barrier();
+}
+
+// One level of the forward transform, rows first. LeGall 5/3 predicts from the two nearest even
+// samples and Deslauriers-Dubuc 9/7 from four, both share the update. Every step rounds to
+// nearest like VC-2, where JPEG 2000 floors the 5/3 prediction instead.
+void wavelet_forward(int dim) {
+    const bool dd = wavelet == WAVELET_DD_9_7;
+    for (int axis = 0; axis < 2; axis++) {
+        if (dd) {
+            lift_step(axis, dim, 1, -1, 9, -1, 8, 4);
+        } else {
+            lift_step(axis, dim, 1, -1, 1, 0, 1, 1);
+        }
+        lift_step(axis, dim, 0, 1, 1, 0, 2, 2);
+    }
+}
+
+// Undoes wavelet_forward for one level, columns first.
+void wavelet_inverse(int dim) {
+    const bool dd = wavelet == WAVELET_DD_9_7;
+    for (int axis = 1; axis >= 0; axis--) {
+        lift_step(axis, dim, 0, -1, 1, 0, 2, 2);
+        if (dd) {
+            lift_step(axis, dim, 1, 1, 9, -1, 8, 4);
+        } else {
+            lift_step(axis, dim, 1, 1, 1, 0, 1, 1);
+        }
+    }
+}
@@ -0,0 +1,290 @@
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "yuv_reader.h"
+
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_FRAME_MAGIC "FRAME"
+#define Y4M_MAX_LINE 1024
+// Frames ahead of the reader that the kernel is asked to read in.
+#define MAPPED_READ_AHEAD_FRAMES 2
+
+uint32_t yuv_frame_size(const struct YuvFormat* format) {
+    const uint32_t luma_size = format->width * format->height;
+    const uint32_t half_width = (format->width + 1) / 2;
+    const uint32_t sample_size = format->bit_depth > 8 ? 2 : 1;
+    switch (format->chroma) {
+    case YUV_CHROMA_420:
+        return (luma_size + 2 * half_width * ((format->height + 1) / 2)) * sample_size;
+    case YUV_CHROMA_422:
+        return (luma_size + 2 * half_width * format->height) * sample_size;
+    case YUV_CHROMA_444:
+        return luma_size * 3 * sample_size;
+    default:
+        return luma_size * sample_size;
+    }
+}
+
+bool parse_yuv_chroma(const char* name, struct YuvFormat* format) {
+    static const struct {
+        const char* prefix;
+        enum YuvChroma chroma;
+    } layouts[] = {
+        {"420", YUV_CHROMA_420},
+        {"422", YUV_CHROMA_422},
+        {"444", YUV_CHROMA_444},
+        {"mono", YUV_CHROMA_MONO},
+    };
+
+    for (uint32_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        const size_t length = strlen(layouts[i].prefix);
+        if (strncmp(name, layouts[i].prefix, length) != 0) {
+            continue;
+        }
+
+        // The 4:2:0 variants only differ in chroma siting, which doesn't change the plane layout.
+        const char* suffix = name + length;
+        format->chroma = layouts[i].chroma;
+        format->bit_depth = 8;
+        const bool siting = format->chroma == YUV_CHROMA_420 &&
+                            (strcmp(suffix, "jpeg") == 0 || strcmp(suffix, "mpeg2") == 0 || strcmp(suffix, "paldv") == 0);
+        if (*suffix == '\0' || siting) {
+            return true;
+        }
+
+        // Deeper samples carry their bit depth, as in "420p10" or "mono16".
+        if (*suffix == 'p') {
+            suffix++;
+        }
+        char* end;
+        const long bit_depth = strtol(suffix, &end, 10);
+        if (end == suffix || *end != '\0' || bit_depth <= 8 || bit_depth > 16) {
+            return false;
+        }
+        format->bit_depth = (uint32_t)bit_depth;
+        return true;
+    }
+    return false;
+}
+
+// Reads up to and including the next newline, which is replaced by a terminator.
+static bool read_line(FILE* file, char* line, uint32_t capacity) {
+    uint32_t length = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        if (length + 1 == capacity) {
+            return false;
+        }
+        line[length++] = (char)c;
+    }
+    line[length] = '\0';
+    return c == '\n';
+}
+
+// The header is a list of space separated parameters, each starting with a tag letter.
+static bool parse_y4m_header(struct YuvReader* reader) {
+    char line[Y4M_MAX_LINE];
+    if (!read_line(reader->file, line, sizeof(line))) {
+        printf("Unable to read the Y4M header\n");
+        return false;
+    }
+
+    reader->format.width = 0;
+    reader->format.height = 0;
+    reader->format.chroma = YUV_CHROMA_420;
+    reader->format.bit_depth = 8;
+    for (char* param = strtok(line, " "); param != NULL; param = strtok(NULL, " ")) {
+        switch (param[0]) {
+        case 'W':
+            reader->format.width = (uint32_t)atoi(param + 1);
+            break;
+        case 'H':
+            reader->format.height = (uint32_t)atoi(param + 1);
+            break;
+        case 'C':
+            if (!parse_yuv_chroma(param + 1, &reader->format)) {
+                printf("Unsupported Y4M colorspace %s, only 4:2:0, 4:2:2, 4:4:4 and mono with up to 16 bits "
+                       "are supported\n", param + 1);
+                return false;
+            }
+            break;
+        default:
+            // Frame rate, interlacing, aspect ratio and extensions don't affect the frame layout.
+            break;
+        }
+    }
+
+    if (reader->format.width == 0 || reader->format.height == 0) {
+        printf("Y4M header is missing the frame size\n");
+        return false;
+    }
+    return true;
+}
+
+// Maps the rest of a regular file, starting at the frame data that follows the header. Pipes and
+// files that can't be mapped keep being read through stdio.
+static void map_file(struct YuvReader* reader) {
+    const int fd = fileno(reader->file);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        return;
+    }
+
+    void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        return;
+    }
+    madvise(mapped, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    // Bytes probed for a Y4M header belong to the first raw frame, which simply starts earlier.
+    reader->mapped = (const uint8_t*)mapped;
+    reader->mapped_size = (size_t)info.st_size;
+    reader->position = (size_t)ftell(reader->file) - reader->prefix_size;
+    reader->prefix_size = 0;
+    reader->dropped = 0;
+}
+
+// Reads up to and including the next newline of the mapping, which is replaced by a terminator.
+static bool read_mapped_line(struct YuvReader* reader, char* line, uint32_t capacity) {
+    const size_t remaining = reader->mapped_size - reader->position;
+    const uint8_t* start = reader->mapped + reader->position;
+    const uint8_t* end = (const uint8_t*)memchr(start, '\n', remaining < capacity ? remaining : capacity);
+    if (!end) {
+        return false;
+    }
+    memcpy(line, start, end - start);
+    line[end - start] = '\0';
+    reader->position += end - start + 1;
+    return true;
+}
+
+// Keeps the page cache footprint to the frames around the reader on large frame stores. Frames
+// behind it are dropped and the next ones are read in while the current one is transformed.
+static void advise_window(struct YuvReader* reader) {
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t behind = reader->position / page_size * page_size;
+    if (behind > reader->dropped) {
+        madvise((void*)(reader->mapped + reader->dropped), behind - reader->dropped, MADV_DONTNEED);
+        posix_fadvise(fileno(reader->file), (off_t)reader->dropped, (off_t)(behind - reader->dropped),
+                      POSIX_FADV_DONTNEED);
+        reader->dropped = behind;
+    }
+
+    const size_t ahead = (size_t)reader->frame_size * MAPPED_READ_AHEAD_FRAMES;
+    const size_t remaining = reader->mapped_size - behind;
+    madvise((void*)(reader->mapped + behind), ahead < remaining ? ahead : remaining, MADV_WILLNEED);
+}
+
+bool open_yuv_reader(struct YuvReader* out_reader, const char* path, const struct YuvFormat* raw_format) {
+    memset(out_reader, 0, sizeof(*out_reader));
+    out_reader->owns_file = strcmp(path, "-") != 0;
+    out_reader->file = out_reader->owns_file ? fopen(path, "rb") : stdin;
+    if (!out_reader->file) {
+        printf("Unable to open %s\n", path);
+        return false;
+    }
+
+    const uint32_t magic_size = sizeof(Y4M_MAGIC) - 1;
+    out_reader->prefix_size = (uint32_t)fread(out_reader->prefix, 1, magic_size, out_reader->file);
+    out_reader->y4m = out_reader->prefix_size == magic_size && memcmp(out_reader->prefix, Y4M_MAGIC, magic_size) == 0;
+    if (out_reader->y4m) {
+        out_reader->prefix_size = 0;
+        if (!parse_y4m_header(out_reader)) {
+            close_yuv_reader(out_reader);
+            return false;
+        }
+    } else if (raw_format) {
+        out_reader->format = *raw_format;
+    } else {
+        printf("%s is not a Y4M stream and no raw frame format was given\n", path);
+        close_yuv_reader(out_reader);
+        return false;
+    }
+
+    out_reader->frame_size = yuv_frame_size(&out_reader->format);
+    if (out_reader->frame_size < out_reader->prefix_size) {
+        printf("Raw frames of %ux%u are too small\n", out_reader->format.width, out_reader->format.height);
+        close_yuv_reader(out_reader);
+        return false;
+    }
+
+    map_file(out_reader);
+    if (out_reader->mapped) {
+        advise_window(out_reader);
+    }
+    return true;
+}
+
+// Copies the next frame out of the mapping, the counterpart of the stdio path below.
+static bool read_mapped_frame(struct YuvReader* reader, uint8_t* dst) {
+    if (reader->y4m) {
+        char line[Y4M_MAX_LINE];
+        if (!read_mapped_line(reader, line, sizeof(line))) {
+            return false;
+        }
+        if (strncmp(line, Y4M_FRAME_MAGIC, sizeof(Y4M_FRAME_MAGIC) - 1) != 0) {
+            printf("Y4M frame %u has no frame header\n", reader->frame_index);
+            return false;
+        }
+    }
+
+    const size_t remaining = reader->mapped_size - reader->position;
+    if (remaining < reader->frame_size) {
+        if (remaining > 0) {
+            printf("Frame %u is truncated, dropping it\n", reader->frame_index);
+        }
+        return false;
+    }
+    memcpy(dst, reader->mapped + reader->position, reader->frame_size);
+    reader->position += reader->frame_size;
+    advise_window(reader);
+
+    reader->frame_index++;
+    return true;
+}
+
+bool yuv_read_frame(struct YuvReader* reader, uint8_t* dst) {
+    if (reader->mapped) {
+        return read_mapped_frame(reader, dst);
+    }
+    if (reader->y4m) {
+        char line[Y4M_MAX_LINE];
+        if (!read_line(reader->file, line, sizeof(line))) {
+            return false;
+        }
+        if (strncmp(line, Y4M_FRAME_MAGIC, sizeof(Y4M_FRAME_MAGIC) - 1) != 0) {
+            printf("Y4M frame %u has no frame header\n", reader->frame_index);
+            return false;
+        }
+    }
+
+    // Reads of a whole frame bypass the stdio buffer and land in dst directly.
+    uint32_t offset = 0;
+    if (reader->prefix_size > 0) {
+        memcpy(dst, reader->prefix, reader->prefix_size);
+        offset = reader->prefix_size;
+        reader->prefix_size = 0;
+    }
+    const size_t num_read = fread(dst + offset, 1, reader->frame_size - offset, reader->file);
+    if (num_read != reader->frame_size - offset) {
+        if (offset + num_read > 0) {
+            printf("Frame %u is truncated, dropping it\n", reader->frame_index);
+        }
+        return false;
+    }
+
+    reader->frame_index++;
+    return true;
+}
+
+void close_yuv_reader(const struct YuvReader* reader) {
+    if (reader->mapped) {
+        munmap((void*)reader->mapped, reader->mapped_size);
+    }
+    if (reader->owns_file && reader->file) {
+        fclose(reader->file);
+    }
+}
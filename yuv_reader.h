@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+enum YuvChroma {
+    YUV_CHROMA_420,
+    YUV_CHROMA_422,
+    YUV_CHROMA_444,
+    YUV_CHROMA_MONO,
+};
+
+// Geometry of planar frames, the planes of a frame are stored back to back.
+struct YuvFormat {
+    uint32_t width;
+    uint32_t height;
+    enum YuvChroma chroma;
+    // Samples deeper than 8 bits take 16 bits each, little endian.
+    uint32_t bit_depth;
+};
+
+// Reads raw planar YUV or YUV4MPEG2 frames sequentially from a file or a pipe. Regular files are
+// mapped and copied from frame by frame, pipes are read through stdio.
+struct YuvReader {
+    FILE* file;
+    bool owns_file;
+    bool y4m;
+    // Whole file mapping, NULL when reading through stdio.
+    const uint8_t* mapped;
+    size_t mapped_size;
+    // Offset of the next frame in the mapping, and of the first byte not yet dropped from the page cache.
+    size_t position;
+    size_t dropped;
+    struct YuvFormat format;
+    uint32_t frame_size;
+    uint32_t frame_index;
+    // Bytes read while probing for a Y4M header that belong to the first raw frame, pipes can't seek.
+    uint8_t prefix[16];
+    uint32_t prefix_size;
+};
+
+uint32_t yuv_frame_size(const struct YuvFormat* format);
+
+// Parses a colorspace such as "420", "422p10", "444p16" or "mono", as used in Y4M headers, into
+// the chroma layout and bit depth of format.
+bool parse_yuv_chroma(const char* name, struct YuvFormat* format);
+
+// Opens path, or stdin for "-". Streams starting with a YUV4MPEG2 header describe their own format,
+// anything else is read as raw frames in raw_format, which may be NULL to only accept Y4M.
+bool open_yuv_reader(struct YuvReader* out_reader, const char* path, const struct YuvFormat* raw_format);
+
+// Reads the planes of the next frame straight into dst, which must hold frame_size bytes. Returns
+// false at the end of the stream or on a truncated frame. Mapped files are copied from the page
+// cache without going through read calls, and frames behind the reader are dropped from the cache.
+bool yuv_read_frame(struct YuvReader* reader, uint8_t* dst);
+
+void close_yuv_reader(const struct YuvReader* reader);